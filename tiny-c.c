@@ -12,6 +12,7 @@
  *
  *  <program> ::= <statement>
  *  <var_def> ::= "int" <id> ";"
+ *  <array_def> ::= "int" <id> "[" <int> "]" ";"
  *  <statement> ::= "if" <paren_expr> <statement> |
  *                  "if" <paren_expr> <statement> "else" <statement> |
  *                  "while" <paren_expr> <statement> |
@@ -27,12 +28,14 @@
  *  <test> ::= <math> | <math> "<" <math> | <math> ">" <math>
  *  <math> ::= <term> | <math> <math_op> <term>
  *  <math_op> ::= "+" | "-" | "*" | "/"
- *  <term> ::= <id> | <int> | <paren_expr>
+ *  <term> ::= <id> | <id> "[" <expr> "]" | <int> | <paren_expr>
  *  <id> ::= "a" | "b" | "c" | "d" | ... | "z" -- FOR NOW
  *  <id> ::= [A-Z|a-z][A-Z|a-z|0-9|_]*
  *  <int> ::= <an_unsigned_decimal_integer>
- *  <func_def> ::= "void" <id> "(" ")" "{" <statement> "}" |
- *  <func_call> ::= <id> "(" ")" ";"
+ *  <func_def> ::= "void" <id> "(" <params> ")" "{" <statement> "}" |
+ *  <params> ::= "" | "int" <id> | <params> "," "int" <id>
+ *  <func_call> ::= <id> "(" <args> ")" ";"
+ *  <args> ::= "" | <expr> | <args> "," <expr>
  *
  * The compiler does a minimal amount of error checking to help
  * highlight the structure of the compiler.
@@ -41,9 +44,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
- /*---------------------------------------------------------------------------*/
-/* Lexer. */
+#include <time.h>
+#include <limits.h>
+#ifdef IS_LINUX
+#include <signal.h>   /* SIGPROF sampling (-D SAMPLES); before the ctx name macros */
+#include <sys/time.h>
+#include <sys/mman.h> /* executable buffer for the jit (-j) */
+#include <pthread.h>  /* --jobs workers and the parallel frontend (-t) */
+#endif
 
 #define MAX_NODES   1000
 #define DICT_SZ      999
@@ -54,29 +62,218 @@
 typedef unsigned int uint;
 typedef unsigned char byte;
 
+/*---------------------------------------------------------------------------*/
+/* Compiler context. */
+
+/* Every piece of mutable compiler/VM state lives in one mc_ctx so --jobs
+   can compile and run independent scripts on separate threads. C is a
+   thread-local pointer and the old global names are #defined onto its
+   fields below, so the rest of the file reads exactly as it did when the
+   state really was global. */
+
+typedef struct node_s { int kind; struct node_s *o1, *o2, *o3; int val, tail; } node_t;
+typedef struct chunk_s { struct chunk_s *next; int size, used; node_t nodes[1]; } chunk_t;
+typedef struct dict_s { int kind; long val; int nm; int reg, refs, args; } dict_t;
+typedef int code;
+
+#define HASH_SZ  2048        /* power of two, > DICT_SZ */
+#define NUM_REGS    8
+#define MAX_PARS    8
+#define FRAME_SZ 4096
+#define MAX_IDS  2048        /* distinct identifiers */
+#define ITAB_SZ  4096        /* power of two, > MAX_IDS */
+#define POOL_SZ 32768        /* bytes of identifier text */
+
+typedef struct mc_ctx_s {
+    /* lexer */
+    int ch, sym, int_val;
+    char id_name[64];
+    char *src;
+    int src_len, src_pos;
+    /* identifier interning */
+    char pool[POOL_SZ];
+    int pool_used;
+    int ioff[MAX_IDS], num_ids;
+    int itab[ITAB_SZ];
+    int id_int;              /* intern id of the last ID/FUNC token */
+    /* parser */
+    int num_nodes, last;
+    chunk_t *arena;
+    dict_t dict[DICT_SZ+1];
+    int hidx[HASH_SZ];
+    int par_nm[MAX_PARS], num_pars;
+    int in_func;             /* parsing depth inside a function body */
+    node_t *func_body[DICT_SZ+1];
+    /* array heap */
+    long *heap;
+    int heap_sz, heap_used;
+    /* code generator */
+    code *vm;
+    int vm_sz, here;
+    byte *is_tgt;
+    int reg_slot[NUM_REGS];
+    /* profiling */
+    int prof;
+    long callcnt[DICT_SZ+1];
+    /* virtual machine */
+    int sp, rsp, fp, lf;
+    long regs[NUM_REGS];
+#ifdef IS_LINUX
+    long *st_mem, *rst_mem, *frm_mem;    /* guarded stacks (see stacks_init) */
+    char *st_base, *rst_base, *frm_base; /* mmap bases including the guards */
+#else
+    long frames[FRAME_SZ];
+#endif
+} mc_ctx;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TLOCAL __thread
+#else
+#define TLOCAL __declspec(thread) /* MSVC */
+#endif
+
+TLOCAL mc_ctx *C;
+
+void error(char *err); /* forward declaration */
+
+mc_ctx *ctx_new() { /* before the name macros: x->ch is the real field here */
+    mc_ctx *x = (mc_ctx *)calloc(1, sizeof(mc_ctx));
+    if (x == NULL) { error("-out of memory-"); }
+    x->ch = ' ';
+    return x;
+}
+
+/* The old global names, mapped onto the current context. */
+#define ch        (C->ch)
+#define sym       (C->sym)
+#define int_val   (C->int_val)
+#define id_name   (C->id_name)
+#define src       (C->src)
+#define src_len   (C->src_len)
+#define src_pos   (C->src_pos)
+#define pool      (C->pool)
+#define pool_used (C->pool_used)
+#define ioff      (C->ioff)
+#define num_ids   (C->num_ids)
+#define itab      (C->itab)
+#define id_int    (C->id_int)
+#define num_nodes (C->num_nodes)
+#define last      (C->last)
+#define arena     (C->arena)
+#define dict      (C->dict)
+#define hidx      (C->hidx)
+#define par_nm    (C->par_nm)
+#define num_pars  (C->num_pars)
+#define in_func   (C->in_func)
+#define func_body (C->func_body)
+#define heap      (C->heap)
+#define heap_sz   (C->heap_sz)
+#define heap_used (C->heap_used)
+#define vm        (C->vm)
+#define vm_sz     (C->vm_sz)
+#define here      (C->here)
+#define is_tgt    (C->is_tgt)
+#define reg_slot  (C->reg_slot)
+#define prof      (C->prof)
+#define callcnt   (C->callcnt)
+#define sp        (C->sp)
+#define rsp       (C->rsp)
+#define fp        (C->fp)
+#define lf        (C->lf)
+#define regs      (C->regs)
+#ifdef IS_LINUX
+#define frames    (C->frm_mem)
+#else
+#define frames    (C->frames)
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Lexer. */
+
 enum {
-    DO_SYM, ELSE_SYM, IF_SYM, WHILE_SYM, VOID_SYM, RET_SYM, LBRA, RBRA, LPAR, RPAR,
-    PLUS, MINUS, STAR, SLASH, LESS, GRT, SEMI, EQUAL, INT, ID, FUNC, EOI
+    DO_SYM, ELSE_SYM, IF_SYM, WHILE_SYM, VOID_SYM, RET_SYM, INT_SYM,
+    LBRA, RBRA, LPAR, RPAR, LBRK, RBRK,
+    PLUS, MINUS, STAR, SLASH, LESS, GRT, SEMI, EQUAL, COMMA, INT, ID, FUNC, EOI
 };
 
-char *words[] = { "do", "else", "if", "while", "void", "return", NULL };
+char *words[] = { "do", "else", "if", "while", "void", "return", "int", NULL };
+
+void message(char *msg); /* forward declaration */
+
+/* Identifier interning: every distinct identifier maps to a small dense
+   int (id_int) the first time it is scanned, so keyword recognition and
+   dict[] lookups compare ints instead of strcmp'ing names. lex_init()
+   interns the keywords first, so their ids are the DO_SYM..INT_SYM token
+   values and the keyword test is a single compare. */
+
+char *intern_nm(int id) { return pool + ioff[id]; }
+
+int intern_h(const char *name, uint h) { /* h: djb2 of name, as scanned */
+    h &= (ITAB_SZ-1);
+    while (itab[h]) {
+        int id = itab[h]-1;
+        if (strcmp(intern_nm(id), name)==0) { return id; }
+        h = (h+1) & (ITAB_SZ-1);
+    }
+    int n = (int)strlen(name)+1;
+    if (MAX_IDS <= num_ids) { error("-too many identifiers-"); }
+    if (POOL_SZ < pool_used+n) { error("-intern pool full-"); }
+    ioff[num_ids] = pool_used;
+    if (name != pool+pool_used) { memcpy(pool+pool_used, name, n); } /* the lexer scans in place */
+    pool_used += n;
+    itab[h] = ++num_ids;
+    return num_ids-1;
+}
+
+int intern(const char *name) {
+    uint h = 5381;
+    const char *p = name;
+    while (*p) { h = (h*33) ^ (byte)*p++; }
+    return intern_h(name, h);
+}
+
+/* 256-entry character-class table: one indexed load replaces the range
+   compares per character, and EOF casts to an unclassified 255. */
+#define CC_ALPHA 1
+#define CC_NUM   2
+byte cclass[256];
+
+#define isAlpha(x)    (cclass[(byte)(x)] & CC_ALPHA)
+#define isNum(x)      (cclass[(byte)(x)] & CC_NUM)
+#define isAlphaNum(x) (cclass[(byte)(x)])
+
+void lex_init() { /* keywords get intern ids 0..6 */
+    for (int i='A'; i<='Z'; i++) { cclass[i] = CC_ALPHA; }
+    for (int i='a'; i<='z'; i++) { cclass[i] = CC_ALPHA; }
+    cclass['_'] = CC_ALPHA;
+    for (int i='0'; i<='9'; i++) { cclass[i] = CC_NUM; }
+    for (int i=0; words[i]; i++) { intern(words[i]); }
+}
 
-int ch = ' ', sym, int_val;
-char id_name[64];
-FILE *input_fp = NULL;
+/* Slurp the whole file into src[] (NULL => stdin) so the lexer can advance
+   by pointer arithmetic instead of one fgetc() call per character. */
+void read_source(const char *fn) {
+    FILE *fo = fopen(fn, "rb");
+    if (fo == NULL) { error("-cannot open input-"); }
+    fseek(fo, 0, SEEK_END);
+    src_len = (int)ftell(fo);
+    fseek(fo, 0, SEEK_SET);
+    src = (char *)malloc(src_len+1);
+    if (src == NULL) { error("-out of memory-"); }
+    src_len = (int)fread(src, 1, src_len, fo);
+    src[src_len] = 0;
+    fclose(fo);
+}
 
 void next_ch() {
-    if (input_fp) { ch = fgetc(input_fp); }
-    else { ch = getchar(); }
+    if (src) { ch = (src_pos < src_len) ? (byte)src[src_pos++] : EOF; }
+    else { ch = getchar(); } /* streaming fallback for stdin */
     // if (BTWI(ch,32,126)) { printf("%c", ch); } else { printf("(%d)", ch); }
 }
 
 void message(char *msg) { fprintf(stdout, "%s\n", msg); }
 void error(char *err) { message(err); exit(1); }
 void syntax_error() { error("-syntax error-"); }
-int isAlpha(int ch) { return BTWI(ch,'A','Z') || BTWI(ch,'a','z') || (ch=='_'); }
-int isNum(int ch) { return BTWI(ch,'0','9'); }
-int isAlphaNum(int ch) { return isAlpha(ch) || isNum(ch); }
 void lcomment() { while (ch !=EOF && ch!='\n') { next_ch(); } }
 
 void next_sym() {
@@ -88,6 +285,8 @@ void next_sym() {
       case '}': next_ch(); sym = RBRA;  break;
       case '(': next_ch(); sym = LPAR;  break;
       case ')': next_ch(); sym = RPAR;  break;
+      case '[': next_ch(); sym = LBRK;  break;
+      case ']': next_ch(); sym = RBRK;  break;
       case '+': next_ch(); sym = PLUS;  break;
       case '-': next_ch(); sym = MINUS; break;
       case '*': next_ch(); sym = STAR;  break;
@@ -97,24 +296,30 @@ void next_sym() {
       case '>': next_ch(); sym = GRT;   break;
       case ';': next_ch(); sym = SEMI;  break;
       case '=': next_ch(); sym = EQUAL; break;
+      case ',': next_ch(); sym = COMMA; break;
       default:
         if (isNum(ch)) {
             int_val = 0; /* missing overflow check */
             while (isNum(ch)) { int_val = int_val*10 + (ch - '0'); next_ch(); }
             sym = INT;
         } else if (isAlpha(ch)) {
-            int i = 0; /* missing overflow check */
-            while (isAlphaNum(ch)) { id_name[i++]=ch; next_ch(); }
+            int i = 0, n = 0;
+            uint h = 5381; /* intern hash folded into the scan - one pass per byte */
+            char *nm = pool + pool_used; /* scan into the pool's free tail: no length cap */
+            while (isAlphaNum(ch)) {
+                if (POOL_SZ <= pool_used + n + 1) { error("-intern pool full-"); }
+                nm[n++] = ch;
+                h = (h*33) ^ (byte)ch;
+                if (i < 63) { id_name[i++] = ch; } /* display copy for messages */
+                next_ch();
+            }
+            nm[n] = '\0';
             id_name[i] = '\0';
-            sym = 0;
-            while (words[sym] != NULL && strcmp(words[sym], id_name) != 0) { sym++; }
-            if (words[sym] == NULL) {
+            id_int = intern_h(nm, h);
+            if (id_int <= INT_SYM) { sym = id_int; } /* keywords intern to their token values */
+            else {
               sym = ID;
-              if (ch=='(') {
-                  next_ch();
-                  if (ch==')') { sym = FUNC; next_ch(); }
-                  else { syntax_error(); }
-              }
+              if (ch=='(') { sym = FUNC; next_ch(); } /* '(' consumed; the parser handles the args */
             }
         } else { message("-ch-"); syntax_error(); }
         break;
@@ -125,39 +330,106 @@ void next_sym() {
 /* Parser. */
 
 enum { VAR, CST, ADD, SUB, MUL, DIV, LT, GT, SET, FUNC_DEF, FUNC_CALL, RET,
-       IF1, IF2, WHILE, DO, EMPTY, SEQ, EXPR, PROG };
+       IF1, IF2, WHILE, DO, EMPTY, SEQ, EXPR, PROG, SHL, SHR, VARL,
+       AGET, AARR, CACHED, NCALL };
 
-typedef struct node_s { int kind; struct node_s *o1, *o2, *o3; int val; } node_t;
-int num_nodes = 0, last;
-node_t nodes[MAX_NODES];
+/* Nodes come from a bump-allocated chunk arena that grows geometrically
+   (each chunk doubles) and is released wholesale by arena_free() once
+   codegen is done - the tree is dead after c() has run. */
+node_t *arena_alloc() {
+    if ((arena == NULL) || (arena->size <= arena->used)) {
+        int sz = arena ? arena->size*2 : MAX_NODES;
+        chunk_t *c = (chunk_t *)malloc(sizeof(chunk_t) + (sz-1)*sizeof(node_t));
+        if (c == NULL) { error("-out of memory-"); }
+        c->next = arena; c->size = sz; c->used = 0;
+        arena = c;
+    }
+    return &arena->nodes[arena->used++];
+}
 
-#define IsVar   0
-#define IsFunc  1
+void arena_free() {
+    while (arena) { chunk_t *c = arena; arena = c->next; free(c); }
+}
 
-typedef struct dict_s { int kind; long val; char nm[16]; } dict_t;
-dict_t dict[DICT_SZ+1];
+#define IsVar    0
+#define IsFunc   1
+#define IsArr    2
+#define IsNative 3
 
-int dict_add(const char *name, int kind) {
+/* Arrays live in one contiguous heap[] region: dict val is the base
+   offset and args doubles as the length (arrays take no arguments).
+   Declarations allocate at parse time, like dict_add for scalars. */
+void heap_need(int n) { /* grow heap[] so n cells fit, new cells zeroed */
+    if (heap_sz < n) {
+        int sz = heap_sz ? heap_sz : 1024;
+        while (sz < n) { sz *= 2; }
+        heap = (long *)realloc(heap, sz*sizeof(long));
+        if (heap == NULL) { error("-out of memory-"); }
+        memset(heap+heap_sz, 0, (sz-heap_sz)*sizeof(long));
+        heap_sz = sz;
+    }
+}
+
+/* Parameters of the function being parsed. They compile to frame-relative
+   slots (VARL nodes / FETCHL-STOREL opcodes), not dict[] entries. */
+int par_find(int id) { /* 1-based; 0 means not a parameter */
+    for (int i=0; i<num_pars; i++) {
+        if (par_nm[i]==id) { return i+1; }
+    }
+    return 0;
+}
+
+/* The most-referenced variables are promoted out of dict[] into a small
+   dense register file (regs[] in the VM) with single-byte operands.
+   reg is 1-based in dict_t; 0 means the variable stays in its dict slot.
+   reg_slot[] maps register -> dict slot, for dumps and copy-back. */
+void regalloc() {
+    for (int r=0; r<NUM_REGS; r++) {
+        int best=0;
+        for (int i=1; i<=last; i++) {
+            if ((dict[i].kind==IsVar) && (dict[i].reg==0)
+                && (best==0 || dict[best].refs < dict[i].refs)) { best=i; }
+        }
+        if (best==0) { return; }
+        dict[best].reg = r+1;
+        reg_slot[r] = best;
+    }
+}
+
+/* Open-addressing hash index over dict[] so lookup is O(1) instead of a
+   linear strcmp walk. Slot numbers are unchanged - FETCH/STORE/ICALL
+   operands still index dict[] directly. Slot 0 marks an empty bucket. */
+uint dict_hash(int nm, int kind) {
+    return ((uint)nm*2654435761u + (uint)kind) & (HASH_SZ-1);
+}
+
+int dict_add(int nm, int kind) {
+    if (DICT_SZ <= last) { error("-dictionary full-"); }
     dict_t *p=&dict[++last];
     p->kind = kind;
-    strcpy(p->nm, name);
+    p->nm = nm;
+    uint h = dict_hash(nm, kind);
+    while (hidx[h]) { h = (h+1) & (HASH_SZ-1); }
+    hidx[h] = last;
     return last;
 }
 
-int dict_find(const char *name, int kind) {
-    int i=last;
-    while (i) {
-        dict_t *p=&dict[i];
-        if ((strcmp(p->nm, name)==0) && (p->kind==kind)) { return i; }
-        i--;
+int dict_find(int nm, int kind) {
+    uint h = dict_hash(nm, kind);
+    while (hidx[h]) {
+        dict_t *p=&dict[hidx[h]];
+        if ((p->nm==nm) && (p->kind==kind)) { return hidx[h]; }
+        h = (h+1) & (HASH_SZ-1);
     }
     return 0;
 }
 
 node_t *new_node(int k) {
-    if (MAX_NODES <= num_nodes) { error(""); }
-    node_t *x = &nodes[num_nodes++];
+    node_t *x = arena_alloc();
+    num_nodes++;
     x->kind = k;
+    x->o1 = x->o2 = x->o3 = NULL;
+    x->val = x->tail = 0;
     return x;
 }
 
@@ -175,16 +447,278 @@ void expect_sym(int exp) {
     next_sym();
 }
 
-node_t *paren_expr(); /* forward declaration */
+/*---------------------------------------------------------------------------*/
+/* Native builtins. */
+
+/* A small registry of host functions callable from scripts. Each gets a
+   dict[] entry of kind IsNative whose val indexes natives[] directly, so
+   INATIVE dispatch is one table load - no name lookup at call time.
+   Native calls are terms: they push their result and can sit anywhere in
+   an expression, unlike script functions. */
+
+long nv_min(long *a)   { return (a[0] < a[1]) ? a[0] : a[1]; }
+long nv_max(long *a)   { return (a[0] < a[1]) ? a[1] : a[0]; }
+long nv_abs(long *a)   { return (a[0] < 0) ? -a[0] : a[0]; }
+long nv_clamp(long *a) { return (a[0] < a[1]) ? a[1] : ((a[2] < a[0]) ? a[2] : a[0]); }
+
+typedef struct { char *nm; int args; long (*fn)(long *a); } native_t;
+
+native_t natives[] = {
+    { "min",   2, nv_min   },
+    { "max",   2, nv_max   },
+    { "abs",   1, nv_abs   },
+    { "clamp", 3, nv_clamp },
+};
+#define NUM_NATIVES (int)(sizeof(natives)/sizeof(natives[0]))
+
+void natives_init() { /* registered before parsing, so calls just resolve */
+    for (int i=0; i<NUM_NATIVES; i++) {
+        int s = dict_add(intern(natives[i].nm), IsNative);
+        dict[s].val = i;
+        dict[s].args = natives[i].args;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Compilation cache. */
+
+/* -i: incremental recompilation. Each top-level function definition is
+   keyed by a hash of the source up to and including its body, so a key
+   matches only when the function AND everything before it are unchanged -
+   identical prefixes assign identical intern ids and dict slots, which is
+   what makes the cached cells reusable. On a hit the parse is skipped:
+   the entry replays the dict[] entries and refs counts the parse would
+   have produced and c() splices the previously generated cells into vm[]
+   wherever they land (jumps are fix()ed relative, calls resolve through
+   dict[], so the span relocates freely). regalloc() depends on refs
+   across the whole program, so after it runs the register map is checked
+   against the one the cache was built with; a mismatch means the cached
+   FETCHR/STORER operands are stale and compile() starts over cold. */
+
+#define CACHE_FILE  "mc.bcc"
+#define CACHE_MAGIC 0x34434342 /* "BCC4" */
+#define MAX_CENTS    256       /* top-level function definitions */
+
+typedef struct { char nm[64]; int kind, args, refs; long val; } cdict_t;
+typedef struct { int slot, add; } cref_t;
+
+typedef struct {             /* one top-level def: parse effects + cells */
+    uint key;
+    int nd, nr, ncell;
+    cdict_t *ds;             /* dict entries the parse created, in order */
+    cref_t *rs;              /* refs added to pre-existing slots */
+    code *cells;
+    int d0, vstart, vend, hit, dead; /* bookkeeping for entries built this run */
+} cent_t;
+
+int inc, probing;            /* -i given / probing enabled this attempt */
+cent_t cents[MAX_CENTS]; int ncents; /* entries loaded from disk */
+cent_t *crec[MAX_CENTS]; int ncrec;  /* entries to write back, in parse order */
+cent_t *cgen[DICT_SZ+1];     /* function slot -> entry under construction */
+int ck_regmap[NUM_REGS], ck_hits;
+int refs_snap[DICT_SZ+1];
+
+void vm_need(int n); /* forward declaration */
+
+int span_end(int i) { /* raw scan to just past the matching '}', 0 if none */
+    int d = 0;
+    while (i < src_len) {
+        if ((src[i]=='/') && (i+1 < src_len) && (src[i+1]=='/')) {
+            while ((i < src_len) && (src[i] != '\n')) { i++; }
+        }
+        else if (src[i]=='{') { d++; i++; }
+        else if (src[i]=='}') { d--; i++; if (d==0) { return i; } }
+        else { i++; }
+    }
+    return 0;
+}
+
+int cache_span_end() { return span_end(src_pos-1); } /* src[src_pos-1] is the lookahead ch */
+
+uint cache_key(int end) {
+    uint h = 5381;
+    for (int i=0; i<end; i++) { h = (h*33) ^ (byte)src[i]; }
+    return h;
+}
+
+cent_t *cache_find(uint key) {
+    for (int i=0; i<ncents; i++) {
+        if ((cents[i].hit==0) && (cents[i].key==key)) { return &cents[i]; }
+    }
+    return NULL;
+}
+
+void cache_replay(cent_t *e) { /* redo what parsing the span would have done */
+    e->d0 = last;
+    for (int i=0; i<e->nd; i++) {
+        cdict_t *d = &e->ds[i];
+        int s = dict_add(intern(d->nm), d->kind);
+        dict[s].args = d->args;
+        dict[s].refs = d->refs;
+        if (d->kind==IsArr) {
+            dict[s].val = heap_used;
+            heap_need(heap_used + d->args);
+            heap_used += d->args;
+        }
+    }
+    for (int i=0; i<e->nr; i++) { dict[e->rs[i].slot].refs += e->rs[i].add; }
+    e->hit = 1;
+    ck_hits++;
+}
+
+void cache_record(cent_t *e) { /* capture the parse effects of a fresh def */
+    int n = 0;
+    e->nd = last - e->d0;
+    e->ds = (cdict_t *)calloc(e->nd ? e->nd : 1, sizeof(cdict_t));
+    e->rs = (cref_t *)calloc(e->d0+1, sizeof(cref_t));
+    if ((e->ds==NULL) || (e->rs==NULL)) { error("-out of memory-"); }
+    for (int i=0; i<e->nd; i++) {
+        dict_t *p = &dict[e->d0+1+i];
+        if (63 < (int)strlen(intern_nm(p->nm))) { e->dead = 1; return; } /* won't fit nm[64]: don't cache */
+        strcpy(e->ds[i].nm, intern_nm(p->nm));
+        e->ds[i].kind = p->kind;
+        e->ds[i].args = p->args;
+        e->ds[i].refs = p->refs;
+    }
+    for (int i=1; i<=e->d0; i++) {
+        if (dict[i].refs != refs_snap[i]) {
+            e->rs[n].slot = i;
+            e->rs[n++].add = dict[i].refs - refs_snap[i];
+        }
+    }
+    e->nr = n;
+}
+
+void cache_splice(cent_t *e) { /* emit a cached span at here */
+    vm_need(here + e->ncell);
+    memcpy(vm+here, e->cells, e->ncell*sizeof(code));
+    for (int i=0; i<e->nd; i++) { /* entry points of the functions inside */
+        if (e->ds[i].kind==IsFunc) { dict[e->d0+1+i].val = here + e->ds[i].val; }
+    }
+    here += e->ncell;
+}
+
+void cache_load() {
+    FILE *fo = fopen(CACHE_FILE, "rb");
+    int magic = 0, n = 0, ok = 1;
+    if (fo == NULL) { return; }
+    ok &= (fread(&magic, sizeof(int), 1, fo)==1) && (magic==CACHE_MAGIC);
+    ok &= ok && ((int)fread(ck_regmap, sizeof(int), NUM_REGS, fo)==NUM_REGS);
+    ok &= ok && (fread(&n, sizeof(int), 1, fo)==1) && BTWI(n, 0, MAX_CENTS);
+    for (int i=0; ok && (i<n); i++) {
+        cent_t *e = &cents[i];
+        ok &= (fread(&e->key, sizeof(uint), 1, fo)==1);
+        ok &= ok && (fread(&e->nd, sizeof(int), 1, fo)==1) && BTWI(e->nd, 0, DICT_SZ);
+        ok &= ok && (fread(&e->nr, sizeof(int), 1, fo)==1) && BTWI(e->nr, 0, DICT_SZ);
+        ok &= ok && (fread(&e->ncell, sizeof(int), 1, fo)==1) && (0 <= e->ncell);
+        if (ok) {
+            e->ds = (cdict_t *)malloc((e->nd ? e->nd : 1)*sizeof(cdict_t));
+            e->rs = (cref_t *)malloc((e->nr ? e->nr : 1)*sizeof(cref_t));
+            e->cells = (code *)malloc((e->ncell ? e->ncell : 1)*sizeof(code));
+            if ((e->ds==NULL) || (e->rs==NULL) || (e->cells==NULL)) { error("-out of memory-"); }
+            ok &= ((int)fread(e->ds, sizeof(cdict_t), e->nd, fo)==e->nd);
+            ok &= ok && ((int)fread(e->rs, sizeof(cref_t), e->nr, fo)==e->nr);
+            ok &= ok && ((int)fread(e->cells, sizeof(code), e->ncell, fo)==e->ncell);
+        }
+        if (ok) { ncents = i+1; }
+    }
+    fclose(fo);
+    if (!ok) { ncents = 0; } /* stale or truncated: every def recompiles */
+}
+
+void cache_save() {
+    FILE *fo = fopen(CACHE_FILE, "wb");
+    int magic = CACHE_MAGIC;
+    if (fo == NULL) { error("-cannot create cache-"); }
+    fwrite(&magic, sizeof(int), 1, fo);
+    fwrite(reg_slot, sizeof(int), NUM_REGS, fo);
+    int n = 0;
+    for (int i=0; i<ncrec; i++) { n += (crec[i]->dead==0); }
+    fwrite(&n, sizeof(int), 1, fo);
+    for (int i=0; i<ncrec; i++) {
+        cent_t *e = crec[i];
+        if (e->dead) { continue; }
+        if (!e->hit) { /* fresh: the cells are still sitting in vm[] */
+            e->ncell = e->vend - e->vstart;
+            for (int k=0; k<e->nd; k++) {
+                if (e->ds[k].kind==IsFunc) { e->ds[k].val = dict[e->d0+1+k].val - e->vstart; }
+            }
+        }
+        fwrite(&e->key, sizeof(uint), 1, fo);
+        fwrite(&e->nd, sizeof(int), 1, fo);
+        fwrite(&e->nr, sizeof(int), 1, fo);
+        fwrite(&e->ncell, sizeof(int), 1, fo);
+        fwrite(e->ds, sizeof(cdict_t), e->nd, fo);
+        fwrite(e->rs, sizeof(cref_t), e->nr, fo);
+        fwrite(e->hit ? e->cells : vm + e->vstart, sizeof(code), e->ncell, fo);
+    }
+    fclose(fo);
+}
+
+void cache_reset() { /* drop this attempt's records before the cold retry */
+    for (int i=0; i<ncrec; i++) {
+        if (!crec[i]->hit) { free(crec[i]->ds); free(crec[i]->rs); free(crec[i]); }
+    }
+    ncrec = ck_hits = 0;
+    memset(cgen, 0, sizeof(cgen));
+    probing = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+node_t *paren_expr(); /* forward declarations */
+node_t *expr();
+node_t *par_splice(); /* parallel frontend (below program) */
+int par_on;           /* top-level spans were parsed by worker threads */
+TLOCAL int par_wkr;   /* set while this thread is a parser worker */
 
 /* <term> ::= <id> | <int> | <paren_expr> */
 node_t *term() {
   node_t *x;
   if (sym == ID) {
+      int pi = par_find(id_int);
+      if (pi) {
+          x=new_node(VARL);
+          x->val=pi-1;
+          next_sym();
+          return x;
+      }
+      int nm = id_int;
+      next_sym();
+      if (sym == LBRK) { /* <id> "[" <expr> "]" */
+          x=new_node(AGET);
+          x->val = dict_find(nm, IsArr);
+          if (x->val == 0) { printf("-%s[] not declared-", intern_nm(nm)); syntax_error(); }
+          next_sym();
+          x->o1 = expr();
+          expect_sym(RBRK);
+          return x;
+      }
+      int a = dict_find(nm, IsArr);
+      if (a) { /* bare array name: block fill/copy operand */
+          x=new_node(AARR);
+          x->val=a;
+          return x;
+      }
       x=new_node(VAR);
-      x->val=dict_find(id_name,IsVar);
-      if (x->val==0) { x->val=dict_add(id_name,IsVar); }
+      x->val=dict_find(nm,IsVar);
+      if (x->val==0) { x->val=dict_add(nm,IsVar); }
+      dict[x->val].refs++;
+  } else if (sym == FUNC) { /* native call: <id> "(" <args> ")" */
+      int s = dict_find(id_int, IsNative);
+      if (s == 0) { printf("-%s() not allowed here-", id_name); syntax_error(); }
+      x=new_node(NCALL);
+      x->val = s;
+      next_sym();
+      int n = 0;
+      x->o1 = new_node(EMPTY); /* argument chain, in call order */
+      while (sym != RPAR) {
+          x->o1 = gen(SEQ, x->o1, expr());
+          n++;
+          if (sym == COMMA) { next_sym(); }
+      }
       next_sym();
+      if (n != dict[s].args) { printf("-%s() takes %d args-", intern_nm(dict[s].nm), dict[s].args); syntax_error(); }
   } else if (sym == INT) {
       x=new_node(CST);
       x->val=int_val;
@@ -226,7 +760,7 @@ node_t *expr() {
   node_t *x;
   if (sym != ID) { return test(); }
   x = test();
-  if ((x->kind==VAR) && (sym==EQUAL)) {
+  if (((x->kind==VAR) || (x->kind==VARL) || (x->kind==AGET) || (x->kind==AARR)) && (sym==EQUAL)) {
       next_sym();
       return gen(SET, x, expr());
   }
@@ -259,12 +793,26 @@ node_t *statement() {
      next_sym();
      x->o1=paren_expr();
      x->o2=statement();
-  } else if (sym == FUNC) { /* <id> "();" */
+  } else if (sym == FUNC) { /* <id> "(" <args> ")" ";" */
+      if (dict_find(id_int, IsNative)) { /* native as a statement: result dropped */
+          x = gen(EXPR, expr(), NULL);
+          expect_sym(SEMI);
+          return x;
+      }
       x=new_node(FUNC_CALL);
-      x->val = dict_find(id_name, IsFunc);
+      x->val = dict_find(id_int, IsFunc);
       if (x->val == 0) { printf("-%s() not defined-", id_name); syntax_error(); }
       // printf("-call %s(%d)-", id_name, x->val);
       next_sym();
+      int n = 0;
+      x->o1 = new_node(EMPTY); /* argument chain, in call order */
+      while (sym != RPAR) {
+          x->o1 = gen(SEQ, x->o1, expr());
+          n++;
+          if (sym == COMMA) { next_sym(); }
+      }
+      next_sym();
+      if (n != dict[x->val].args) { printf("-%s() takes %d args-", intern_nm(dict[x->val].nm), dict[x->val].args); syntax_error(); }
       expect_sym(SEMI);
   } else if (sym == RET_SYM) { /* "return" ";" */
       next_sym();
@@ -288,15 +836,79 @@ node_t *statement() {
         x->o2=statement();
       }
       next_sym();
+  } else if (sym==INT_SYM) { /* "int" <id> "[" <int> "]" ";" | "int" <id> ";" */
+      next_sym();
+      if (sym != ID) { syntax_error(); }
+      int nm = id_int;
+      next_sym();
+      x = new_node(EMPTY); /* declarations emit no code */
+      if (sym == LBRK) {
+          next_sym();
+          if (sym != INT) { syntax_error(); }
+          if (int_val < 1) { error("-bad array size-"); }
+          if (dict_find(nm, IsArr)) { printf("-%s[] already declared-", intern_nm(nm)); syntax_error(); }
+          int a = dict_add(nm, IsArr);
+          dict[a].val = heap_used;
+          dict[a].args = int_val; /* length (arrays take no arguments) */
+          heap_need(heap_used + int_val);
+          heap_used += int_val;
+          next_sym();
+          expect_sym(RBRK);
+      } else if (dict_find(nm, IsVar)==0) { dict_add(nm, IsVar); }
+      expect_sym(SEMI);
   } else if (sym==VOID_SYM) {
-        next_sym(); expect_sym(FUNC);
+        if (par_on && !par_wkr && (in_func==0)) { /* a worker already parsed this span */
+            x = par_splice();
+            if (x) { return x; }
+        }
+        cent_t *ce = NULL;
+        if (probing && src && (in_func==0)) { /* top-level def: try the cache */
+            int end = cache_span_end();
+            if (end) {
+                uint key = cache_key(end);
+                cent_t *e = cache_find(key);
+                if (e && (ncrec < MAX_CENTS)) { /* unchanged: skip the parse */
+                    cache_replay(e);
+                    crec[ncrec++] = e;
+                    src_pos = end; next_ch(); next_sym();
+                    x = new_node(CACHED);
+                    x->val = ncrec-1;
+                    return x;
+                }
+                if ((e==NULL) && (ncrec < MAX_CENTS)) { /* record it for next time */
+                    ce = (cent_t *)calloc(1, sizeof(cent_t));
+                    if (ce == NULL) { error("-out of memory-"); }
+                    ce->key = key; ce->d0 = last;
+                    for (int i=1; i<=last; i++) { refs_snap[i] = dict[i].refs; }
+                    crec[ncrec++] = ce;
+                }
+            }
+        }
+        next_sym();
+        if (sym != FUNC) { expect_sym(FUNC); }
         // printf("-def %s()-", id_name);
         x=new_node(FUNC_DEF);
-        x->val = dict_find(id_name, IsFunc);
+        x->val = dict_find(id_int, IsFunc);
         if (x->val) { printf("-%s() already defined-", id_name); syntax_error(); }
-        x->val = dict_add(id_name, IsFunc);
+        x->val = dict_add(id_int, IsFunc); /* name grabbed before the params clobber id_int */
+        next_sym();
+        num_pars = 0;
+        while (sym == INT_SYM) { /* "int" <id> ("," "int" <id>)* */
+            next_sym();
+            if (sym != ID) { syntax_error(); }
+            if (MAX_PARS <= num_pars) { error("-too many parameters-"); }
+            par_nm[num_pars++] = id_int;
+            next_sym();
+            if (sym == COMMA) { next_sym(); }
+        }
+        expect_sym(RPAR);
+        dict[x->val].args = num_pars;
         if (sym != LBRA) { expect_sym(LBRA); }
+        in_func++;
         x->o1=statement();
+        in_func--;
+        num_pars = 0;
+        if (ce) { cache_record(ce); cgen[x->val] = ce; }
   } else { /* <expr> ";" */
       x = gen(EXPR, expr(), NULL);
       expect_sym(SEMI);
@@ -313,163 +925,1571 @@ node_t *program() {
 }
 
 /*---------------------------------------------------------------------------*/
-/* Code generator. */
+/* Parallel frontend. */
+
+/* -t N: big scripts are mostly independent top-level function definitions,
+   so the frontend splits into two phases. A raw pre-scan finds the spans
+   ("void" name, scanned arity, matching-brace extent) plus any top-level
+   array declarations, then N worker threads parse spans concurrently, each
+   into its own mc_ctx seeded with every span's name (so cross-calls
+   resolve) and the top-level arrays. The main thread then parses the
+   program serially as usual; when statement() reaches a span a worker
+   handled, par_splice() grafts the worker's tree in after rewriting its
+   dict slots onto the main context by name - the same skip-and-splice
+   shape the -i cache uses, with a slot remap instead of a cell replay.
+   Worker arenas stay alive until codegen is done. Slot numbering (and so
+   dump order) follows splice order, not textual order. -t disables -i:
+   both exist to skip the serial parse, and splicing wins nothing then. */
+
+#define MAX_SPANS 256
+
+typedef struct {
+    int start, end;   /* src offsets: the 'v' of "void" .. just past '}' */
+    int args;         /* parameter count off the raw header */
+    char nm[64];
+    node_t *tree;     /* worker-parsed FUNC_DEF, slots are worker-local */
+    mc_ctx *ctx;      /* worker context owning the tree's arena and dict */
+} pspan_t;
+
+typedef struct { char nm[64]; int size; } pseed_t; /* top-level array decl */
+
+pspan_t pspans[MAX_SPANS];
+pseed_t pseeds[MAX_SPANS];
+int nps, npseed, par_threads, next_span;
+int ps_over; /* a name the nm[64] records can't hold: parse serially */
+char *par_src; int par_len;
+
+int ps_skip(int i) { /* whitespace and comments */
+    while (i < src_len) {
+        if ((src[i]=='/') && (i+1 < src_len) && (src[i+1]=='/')) {
+            while ((i < src_len) && (src[i] != '\n')) { i++; }
+        }
+        else if ((src[i]==' ') || (src[i]=='\t') || (src[i]=='\n') || (src[i]=='\r')) { i++; }
+        else { break; }
+    }
+    return i;
+}
+
+int ps_word(int i, char *buf) { /* identifier starting at i, returns its end */
+    int n = 0;
+    while ((i < src_len) && isAlphaNum(src[i])) {
+        if (n < 63) { buf[n++] = src[i]; }
+        i++;
+    }
+    buf[n] = 0;
+    return i;
+}
+
+void pscan() { /* record top-level "void" spans and array declarations */
+    int i = 0;
+    char w[64];
+    while (i < src_len) {
+        i = ps_skip(i);
+        if (src_len <= i) { return; }
+        if (!isAlpha(src[i])) { i++; continue; }
+        int j = ps_word(i, w);
+        if ((strcmp(w, "void")==0) && (nps < MAX_SPANS)) {
+            pspan_t *p = &pspans[nps];
+            p->start = i;
+            int k = ps_skip(j);
+            j = ps_word(k, p->nm);
+            if (63 < j-k) { ps_over = 1; }
+            j = ps_skip(j);
+            if ((src_len <= j) || (src[j] != '(') || (p->nm[0]==0)) { syntax_error(); }
+            j++; /* params: one "int" per parameter */
+            while ((j < src_len) && (src[j] != ')')) {
+                j = ps_skip(j);
+                if (isAlpha(src[j])) { j = ps_word(j, w); if (strcmp(w,"int")==0) { p->args++; } }
+                else if (src[j] != ')') { j++; }
+            }
+            p->end = span_end(j);
+            if (p->end == 0) { syntax_error(); }
+            nps++;
+            i = p->end;
+        } else if ((strcmp(w, "int")==0) && (npseed < MAX_SPANS)) {
+            int k = ps_skip(j);
+            j = ps_word(k, w);
+            if (63 < j-k) { ps_over = 1; }
+            j = ps_skip(j);
+            if ((j < src_len) && (src[j]=='[') && w[0]) { /* "int" <id> "[" <int> "]" */
+                pseed_t *s = &pseeds[npseed];
+                strcpy(s->nm, w);
+                j = ps_skip(j+1);
+                s->size = 0;
+                while ((j < src_len) && isNum(src[j])) { s->size = s->size*10 + src[j++]-'0'; }
+                npseed++;
+            }
+            i = j;
+        } else { i = j; }
+    }
+}
+
+void par_parse(pspan_t *p) { /* on a worker: parse one span into a fresh ctx */
+    C = ctx_new();
+    p->ctx = C;
+    lex_init();
+    natives_init();
+    for (int i=0; i<nps; i++) { /* every top-level def resolves by name... */
+        if (&pspans[i] == p) { continue; } /* ...but our own parse adds ours */
+        int s = dict_add(intern(pspans[i].nm), IsFunc);
+        dict[s].args = pspans[i].args;
+    }
+    for (int i=0; i<npseed; i++) { /* top-level arrays: placeholder extents */
+        int a = dict_add(intern(pseeds[i].nm), IsArr);
+        dict[a].val = heap_used;
+        dict[a].args = pseeds[i].size;
+        heap_need(heap_used + pseeds[i].size);
+        heap_used += pseeds[i].size;
+    }
+    src = par_src; src_len = par_len; src_pos = p->start;
+    next_ch(); next_sym();
+    p->tree = statement();
+}
 
-enum { HALT, FETCH, STORE, LIT1, LIT2, LIT, IDROP, IADD, ISUB, IMUL, IDIV,
-        ILT, IGT, JZ, JNZ, JMP, ICALL, IRET };
+int par_slot(mc_ctx *w, int ws, int *map) { /* worker dict slot -> main slot */
+    if (map[ws]) { return map[ws]; }
+    char wnm[64];
+    int kind, args, refs;
+    mc_ctx *save = C; /* the name macros read through C: swap it in briefly */
+    C = w;
+    kind = dict[ws].kind; args = dict[ws].args; refs = dict[ws].refs;
+    strcpy(wnm, intern_nm(dict[ws].nm));
+    C = save;
+    int nm = intern(wnm);
+    int s = dict_find(nm, kind);
+    if (s == 0) {
+        s = dict_add(nm, kind);
+        if (kind==IsArr) { /* declared inside the span: main skipped it */
+            dict[s].val = heap_used;
+            dict[s].args = args;
+            heap_need(heap_used + args);
+            heap_used += args;
+        }
+    }
+    if (kind==IsFunc) { dict[s].args = args; } /* arity off the real parse */
+    if (kind==IsVar)  { dict[s].refs += refs; }
+    map[ws] = s;
+    return s;
+}
+
+void par_remap(mc_ctx *w, node_t *x, int *map) {
+    if (x == NULL) { return; }
+    int k = x->kind;
+    if (k==VAR || k==AGET || k==AARR || k==FUNC_CALL || k==FUNC_DEF || k==NCALL) {
+        x->val = par_slot(w, (int)x->val, map);
+    }
+    par_remap(w, x->o1, map);
+    par_remap(w, x->o2, map);
+    par_remap(w, x->o3, map);
+}
+
+node_t *par_splice() { /* graft the worker tree for the span at the cursor */
+    int map[DICT_SZ+1];
+    for (int i=0; i<nps; i++) { /* "void" is 4 chars plus one of lookahead */
+        pspan_t *p = &pspans[i];
+        if ((p->start == src_pos-5) && p->tree) {
+            memset(map, 0, sizeof(map));
+            par_remap(p->ctx, p->tree, map);
+            mc_ctx *save = C; /* pull the worker's node count across */
+            C = p->ctx; int wn = num_nodes; C = save;
+            num_nodes += wn;
+            src_pos = p->end; next_ch(); next_sym();
+            return p->tree;
+        }
+    }
+    return NULL; /* not a scanned span: fall through to the serial parse */
+}
+
+void par_free() { /* worker trees are dead once c() has run */
+    mc_ctx *save = C;
+    for (int i=0; i<nps; i++) {
+        mc_ctx *w = pspans[i].ctx;
+        if (w == NULL) { continue; }
+        C = w; /* free through the name macros, like run_job does */
+        arena_free();
+        free(heap);
+        C = save;
+        free(w);
+        pspans[i].ctx = NULL;
+    }
+    par_on = nps = npseed = 0;
+}
 
-typedef char code;
-code vm[VM_SZ];
-int here;
+#ifdef IS_LINUX
+pthread_mutex_t par_mtx = PTHREAD_MUTEX_INITIALIZER;
 
-void g(code c) { vm[here++] = c; } /* missing overflow check */
-void g4(int n) {
-    g(n & 0xff); n=(n >> 8);
-    g(n & 0xff); n=(n >> 8);
-    g(n & 0xff); n=(n >> 8);
-    g(n & 0xff);
+void *par_worker(void *arg) {
+    (void)arg;
+    par_wkr = 1;
+    while (1) {
+        pthread_mutex_lock(&par_mtx);
+        int i = next_span++;
+        pthread_mutex_unlock(&par_mtx);
+        if (nps <= i) { par_wkr = 0; return NULL; }
+        par_parse(&pspans[i]);
+    }
 }
-void g2(int n) {
-    g(n & 0xff); n=(n >> 8);
-    g(n & 0xff);
+
+void par_frontend() { /* scan, pre-register, run the workers, then link */
+    pthread_t tid[MAX_SPANS];
+    pscan();
+    if (ps_over) { nps = npseed = 0; } /* truncated names would alias: stay serial */
+    if (nps == 0) { return; }
+    for (int i=0; i<nps; i++) { /* main gets the slots; bodies come later */
+        if (dict_find(intern(pspans[i].nm), IsFunc)) {
+            printf("-%s() already defined-", pspans[i].nm);
+            syntax_error();
+        }
+        int s = dict_add(intern(pspans[i].nm), IsFunc);
+        dict[s].args = pspans[i].args;
+    }
+    par_src = src; par_len = src_len;
+    next_span = 0;
+    int n = BTWI(par_threads, 1, nps) ? par_threads : nps;
+    for (int i=0; i<n-1; i++) { pthread_create(&tid[i], NULL, par_worker, NULL); }
+    mc_ctx *save = C; /* the main thread takes spans too */
+    par_worker(NULL);
+    C = save;
+    for (int i=0; i<n-1; i++) { pthread_join(tid[i], NULL); }
+    par_on = 1;
+}
+#else
+void par_frontend() { error("-no thread support-"); }
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* AST optimizer. */
+
+/* Bottom-up over the tree: fold constant subtrees into single CST nodes
+   and reduce multiply by a power of two to a shift (SHL). Division is
+   left alone: an arithmetic shift rounds toward minus infinity where
+   IDIV truncates, so x/2^k and x>>k disagree for negative x. */
+
+int is_pow2(int n) { return (0 < n) && ((n & (n-1)) == 0); }
+int log2i(int n)   { int s=0; while (1 < n) { n >>= 1; s++; } return s; }
+
+node_t *fold(node_t *x) {
+    if (x == NULL) { return x; }
+    x->o1 = fold(x->o1); x->o2 = fold(x->o2); x->o3 = fold(x->o3);
+    if (!BTWI(x->kind, ADD, GT)) { return x; }
+    node_t *a = x->o1, *b = x->o2;
+    if ((a->kind==CST) && (b->kind==CST)) {
+        switch (x->kind) {
+            case ADD: x->val = a->val + b->val; break;
+            case SUB: x->val = a->val - b->val; break;
+            case MUL: x->val = a->val * b->val; break;
+            case DIV: if (b->val==0) { return x; } x->val = a->val / b->val; break;
+            case LT : x->val = (a->val < b->val)?1:0; break;
+            case GT : x->val = (a->val > b->val)?1:0; break;
+        }
+        x->kind = CST; x->o1 = x->o2 = NULL;
+        return x;
+    }
+    if ((x->kind==MUL) && (a->kind==CST) && is_pow2(a->val)) { /* 2^k*b => b<<k */
+        x->o1 = b; x->o2 = a; a->val = log2i(a->val); x->kind = SHL;
+    } else if ((x->kind==MUL) && (b->kind==CST) && is_pow2(b->val)) {
+        b->val = log2i(b->val); x->kind = SHL;
+    }
+    return x;
 }
 
-int hole() { return here++; }
-void fix(int src, int dst) { vm[src] = dst-src; } /* missing overflow check */
+/* Inline expansion: the body of a small leaf function (no parameters, no
+   calls, no return) is spliced into its call sites in place of the
+   FUNC_CALL node, dropping the ICALL/IRET round-trip entirely. Bodies are
+   shared between sites - c() just walks the subtree again. */
+
+#define INLINE_MAX 24        /* node-count threshold for inlining */
+
+int inl_count(node_t *x) { /* body size in nodes, or -1 if not inlinable */
+    if (x == NULL) { return 0; }
+    if (x->kind==FUNC_CALL || x->kind==FUNC_DEF || x->kind==RET || x->kind==VARL) { return -1; }
+    int a = inl_count(x->o1), b = inl_count(x->o2), c = inl_count(x->o3);
+    if ((a<0) || (b<0) || (c<0)) { return -1; }
+    return 1+a+b+c;
+}
+
+void inline_pass(node_t *x) {
+    if (x == NULL) { return; }
+    if (x->kind==FUNC_DEF) { func_body[x->val] = x->o1; } /* defs precede their calls */
+    inline_pass(x->o1); inline_pass(x->o2); inline_pass(x->o3);
+    if ((x->kind==FUNC_CALL) && (dict[x->val].args==0)) {
+        node_t *b = func_body[x->val];
+        if (b && BTWI(inl_count(b), 0, INLINE_MAX)) { *x = *b; }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Code generator. */
+
+enum { HALT, FETCH, STORE, LIT, IDROP, IADD, ISUB, IMUL, IDIV,
+        ILT, IGT, JZ, JNZ, JMP, ICALL, IRET,
+        FETCHR, STORER, ISHL, ISHR, FETCHL, STOREL, ITCALL,
+        AFETCH, ASTORE, AFILL, ACOPY, INATIVE,
+        /* superinstructions created by fuse(), never emitted by c() */
+        NOP, INCV, DECV, FFLT, FLLT, FJZ, INCR, DECR, RRLT, RLLT, RJZ,
+        FJNZ, RJNZ };
+
+/* The code stream is an aligned array of int32 cells: one cell per opcode
+   and one per operand. run() reads an operand with a single aligned load
+   instead of assembling it from bytes, and jump offsets are full ints.
+   vm[] is a growable buffer; VM_SZ is the initial size. */
+void vm_need(int n) { /* grow vm[] so that n cells fit */
+    if (vm_sz < n) {
+        int sz = vm_sz ? vm_sz : VM_SZ;
+        while (sz < n) { sz *= 2; }
+        vm = (code *)realloc(vm, sz*sizeof(code));
+        if (vm == NULL) { error("-out of memory-"); }
+        vm_sz = sz;
+    }
+}
+
+void g(code c) { vm_need(here+1); vm[here++] = c; }
+
+int hole() { vm_need(here+1); return here++; }
+void fix(int at, int dst) { vm[at] = dst-at; }
+
+void mark_tails(node_t *x) { /* flag calls in tail position (recursing into branches) */
+    if (x == NULL) { return; }
+    if (x->kind==SEQ) { mark_tails(x->o2);
+        if (x->o2 && (x->o2->kind==RET)) { mark_tails(x->o1); } /* "f(); return;" - the return makes f() a tail call */
+    }
+    else if (x->kind==FUNC_CALL) { x->tail = 1; }
+    else if (x->kind==IF1) { mark_tails(x->o2); }
+    else if (x->kind==IF2) { mark_tails(x->o2); mark_tails(x->o3); }
+}
 
 void c(node_t *x) {
     int p1, p2;
     switch (x->kind) {
-        case VAR  : g(FETCH); g2(x->val); break;
-        case CST  : if (BTWI(x->val,0,127)) { g(LIT1); g(x->val); }
-                    else if (BTWI(x->val,128,32767)) { g(LIT2); g2(x->val);  }
-                    else { g(LIT); g4(x->val);  }
+        case VAR  : if (dict[x->val].reg) { g(FETCHR); g(dict[x->val].reg-1); }
+                    else { g(FETCH); g(x->val); }
                     break;
+        case VARL : g(FETCHL); g(x->val); break;
+        case CST  : g(LIT); g(x->val); break;
         case ADD  : c(x->o1);  c(x->o2); g(IADD); break;
         case MUL  : c(x->o1);  c(x->o2); g(IMUL); break;
         case SUB  : c(x->o1);  c(x->o2); g(ISUB); break;
         case DIV  : c(x->o1);  c(x->o2); g(IDIV); break;
         case LT   : c(x->o1);  c(x->o2); g(ILT); break;
         case GT   : c(x->o1);  c(x->o2); g(IGT); break;
-        case SET  : c(x->o2);  g(STORE); g2(x->o1->val); break;
+        case SHL  : c(x->o1);  c(x->o2); g(ISHL); break;
+        case SHR  : c(x->o1);  c(x->o2); g(ISHR); break;
+        case SET  : if ((x->o1->kind==AARR) && (x->o2->kind==AARR)) { /* a = b: block copy */
+                        g(ACOPY); g(x->o1->val); g(x->o2->val); break;
+                    }
+                    c(x->o2);
+                    if (x->o1->kind==AARR) { g(AFILL); g(x->o1->val); } /* a = n: block fill */
+                    else if (x->o1->kind==AGET) { c(x->o1->o1); g(ASTORE); g(x->o1->val); }
+                    else if (x->o1->kind==VARL) { g(STOREL); g(x->o1->val); }
+                    else if (dict[x->o1->val].reg) { g(STORER); g(dict[x->o1->val].reg-1); }
+                    else { g(STORE); g(x->o1->val); }
+                    break;
+        case AGET : c(x->o1); g(AFETCH); g(x->val); break;
+        case NCALL: c(x->o1); g(INATIVE); g(x->val); break; /* args first, in order */
+        case AARR : error("-array used without index-"); break;
         case IF1  : c(x->o1);  g(JZ); p1=hole(); c(x->o2); fix(p1,here); break;
         case IF2  : c(x->o1);  g(JZ); p1=hole(); c(x->o2); g(JMP); p2=hole();
                     fix(p1,here); c(x->o3); fix(p2,here); break;
-        case WHILE: p1=here; c(x->o1); g(JZ); p2=hole(); c(x->o2);
-                    g(JMP); fix(hole(),p1); fix(p2,here); break;
+        case WHILE: /* inverted: test at the bottom, one branch per iteration */
+                    g(JMP); p1=hole(); p2=here; c(x->o2);
+                    fix(p1,here); c(x->o1); g(JNZ); fix(hole(),p2); break;
         case DO   : p1=here; c(x->o1); c(x->o2); g(JNZ); fix(hole(),p1); break;
         case EMPTY: break;
         case SEQ  : c(x->o1); c(x->o2); break;
         case EXPR : c(x->o1); g(IDROP); break;
         case PROG : c(x->o1); g(HALT);  break;
         case RET  : g(IRET); break;
-        case FUNC_DEF : dict[x->val].val=here; c(x->o1); g(IRET); break;
-        case FUNC_CALL: g(ICALL); g2(x->val); break;
+        case FUNC_DEF : dict[x->val].val=here; mark_tails(x->o1); c(x->o1); g(IRET);
+                    if (cgen[x->val]) { cgen[x->val]->vstart = (int)dict[x->val].val; cgen[x->val]->vend = here; }
+                    break;
+        case CACHED: cache_splice(crec[x->val]); break;
+        case FUNC_CALL: c(x->o1); /* args first, in order */
+                    if (x->tail) { g(ITCALL); g(x->val); } /* terminal call: reuse the frame, no rst[] round-trip */
+                    else { g(ICALL); g(x->val); }
+                    break;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Profile-guided layout. */
+
+/* -p counts ICALL/ITCALL targets per dict slot (a branchless add in the
+   handlers) and dumps them to mc.prof after the run. When mc.prof exists
+   at compile time, function bodies are emitted hottest-first so the hot
+   working set packs together at the front of vm[]. */
+
+#define PROF_FILE "mc.prof"
+
+int load_profile() {
+    FILE *fo = fopen(PROF_FILE, "rt");
+    char nm[64]; long n; int any = 0;
+    if (fo == NULL) { return 0; }
+    while (fscanf(fo, "%63s %ld", nm, &n) == 2) {
+        int i = dict_find(intern(nm), IsFunc);
+        if (i) { dict[i].refs = (int)n; any = 1; } /* refs is unused for functions */
+    }
+    fclose(fo);
+    return any;
+}
+
+void save_profile() {
+    FILE *fo = fopen(PROF_FILE, "wt");
+    if (fo == NULL) { error("-cannot create profile-"); }
+    for (int i=1; i<=last; i++) {
+        if ((dict[i].kind==IsFunc) && callcnt[i] && (strlen(intern_nm(dict[i].nm)) < 64)) {
+            fprintf(fo, "%s %ld\n", intern_nm(dict[i].nm), callcnt[i]); /* %63s reads it back */
+        }
+    }
+    fclose(fo);
+}
+
+void collect_funcs(node_t *x, node_t **list, int *n) {
+    if (x == NULL) { return; }
+    if (x->kind==FUNC_DEF) { list[(*n)++] = x; return; } /* nested defs stay with their parent */
+    collect_funcs(x->o1, list, n);
+    collect_funcs(x->o2, list, n);
+    collect_funcs(x->o3, list, n);
+}
+
+int hot_cmp(const void *a, const void *b) {
+    node_t *x = *(node_t **)a, *y = *(node_t **)b;
+    return (dict[y->val].refs > dict[x->val].refs) - (dict[y->val].refs < dict[x->val].refs);
+}
+
+void layout(node_t *prog) { /* emit function bodies in call-frequency order */
+    node_t **list = (node_t **)malloc((last+1) * sizeof(node_t *));
+    int n = 0;
+    if (list == NULL) { error("-out of memory-"); }
+    collect_funcs(prog, list, &n);
+    qsort(list, n, sizeof(node_t *), hot_cmp);
+    for (int i=0; i<n; i++) { c(list[i]); list[i]->kind = EMPTY; }
+    free(list);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Dead code elimination. */
+
+/* Reachability from main: anything main can't call never reaches vm[],
+   so a big shared prelude costs only its parse. Function defs found
+   unreachable become EMPTY nodes before emission and hand back the refs
+   their bodies put on dict[] so regalloc() ranks live uses only. Cached
+   spans (-i) have no tree; their call sites are read off the cells, a
+   dead span is dropped from the splice and the write-back, and its
+   replayed refs are subtracted the same way. */
+
+int op_len(int o); /* forward declaration */
+
+void dce_mark(int s, byte *live, int *work, int *nw) {
+    if (s && (live[s]==0)) { live[s] = 1; work[(*nw)++] = s; }
+}
+
+void dce_scan(node_t *x, byte *live, int *work, int *nw) { /* call sites in a body */
+    if (x == NULL) { return; }
+    if (x->kind==FUNC_CALL) { dce_mark(x->val, live, work, nw); }
+    dce_scan(x->o1, live, work, nw);
+    dce_scan(x->o2, live, work, nw);
+    dce_scan(x->o3, live, work, nw);
+}
+
+void dce_cells(cent_t *e, byte *live, int *work, int *nw) { /* call sites in a cached span */
+    for (int pc=0; pc < e->ncell; pc += op_len(e->cells[pc])) {
+        if ((e->cells[pc]==ICALL) || (e->cells[pc]==ITCALL)) {
+            dce_mark(e->cells[pc+1], live, work, nw);
+        }
+    }
+}
+
+void dce_refs(node_t *x) { /* a dead body gives back the refs it took */
+    if (x == NULL) { return; }
+    if ((x->kind==VAR) && x->val) { dict[x->val].refs--; }
+    dce_refs(x->o1); dce_refs(x->o2); dce_refs(x->o3);
+}
+
+void collect_cached(node_t *x, node_t **list, int *n) {
+    if (x == NULL) { return; }
+    if (x->kind==CACHED) { list[(*n)++] = x; return; }
+    collect_cached(x->o1, list, n);
+    collect_cached(x->o2, list, n);
+    collect_cached(x->o3, list, n);
+}
+
+void dce(node_t *prog) {
+    byte live[DICT_SZ+1];
+    int work[DICT_SZ+1], nw = 0;
+    node_t *defs[DICT_SZ+1], *spans[MAX_CENTS];
+    int ndef = 0, nspan = 0;
+    memset(live, 0, sizeof(live));
+    collect_funcs(prog, defs, &ndef);
+    collect_cached(prog, spans, &nspan);
+    dce_mark(dict_find(intern("main"), IsFunc), live, work, &nw);
+    while (nw) { /* worklist: walk each newly live function for its callees */
+        int s = work[--nw];
+        node_t *b = func_body[s];
+        if (b) { dce_scan(b, live, work, &nw); continue; }
+        for (int i=0; i<nspan; i++) { /* cached: live with the rest of its span */
+            cent_t *e = crec[spans[i]->val];
+            if (BTWI(s, e->d0+1, e->d0+e->nd)) { dce_cells(e, live, work, &nw); }
+        }
+    }
+    for (int i=0; i<ndef; i++) {
+        if (live[defs[i]->val]==0) {
+            dce_refs(defs[i]->o1);
+            if (cgen[defs[i]->val]) { /* dead defs stay out of the cache */
+                cgen[defs[i]->val]->dead = 1;
+                cgen[defs[i]->val] = NULL;
+            }
+            defs[i]->kind = EMPTY;
+        }
+    }
+    for (int i=0; i<nspan; i++) { /* a span dies only when every def in it does */
+        cent_t *e = crec[spans[i]->val];
+        int any = 0;
+        for (int k=0; k<e->nd; k++) { any |= (e->ds[k].kind==IsFunc) && live[e->d0+1+k]; }
+        if (!any) {
+            for (int k=0; k<e->nd; k++) { dict[e->d0+1+k].refs -= e->ds[k].refs; }
+            for (int k=0; k<e->nr; k++) { dict[e->rs[k].slot].refs -= e->rs[k].add; }
+            e->dead = 1;
+            spans[i]->kind = EMPTY;
+        }
     }
 }
 
 /*---------------------------------------------------------------------------*/
 /* Virtual machine. */
 
-int sp, rsp;
+/* regs[] holds the register-allocated variables (see regalloc()).
+   Preallocated frame pool: function parameters live in frames[], lf is the
+   base of the current frame and fp the first free slot, so call entry is a
+   pointer bump plus the argument copies - no allocation.
+   run() caches the top stack slot in a local (tos), so binary ops are one
+   register op plus one memory read - st[] traffic only happens on spill. */
 
-#define ACASE    goto again; case
-#define TOS      st[sp]
-#define NOS      st[sp-1]
 #define f1(a)    vm[a]
-#define fu(a)    (byte)vm[a]
 
-int  f2(int a) { return (f1(a+1)<<8) | fu(a); }
-long f4(int a) { return (f1(a+3)<<24) | (fu(a+2)<<16)| (fu(a+1)<<8) | fu(a); }
+/* Operand, return and frame stacks: 1MB mmap'd regions bracketed by
+   PROT_NONE guard pages. Pages commit lazily on first touch, so the room
+   for deep recursion costs nothing until it is used, and running off
+   either end faults in a guard page the SIGSEGV handler turns into a
+   clean -stack overflow- - no per-opcode bounds checks in the dispatch
+   loop. Elsewhere the old fixed arrays and the explicit frame check stay. */
+#ifdef IS_LINUX
+#define STACK_BYTES (1<<20)
+#define GUARD_PG    4096
+#define FRAME_CHECK
+
+int in_guard(char *a, char *base) {
+    if (base == NULL) { return 0; }
+    return BTWI(a, base, base+GUARD_PG-1)
+        || BTWI(a, base+GUARD_PG+STACK_BYTES, base+2*GUARD_PG+STACK_BYTES-1);
+}
+
+void stack_trap(int sig, siginfo_t *si, void *u) {
+    char *a = (char *)si->si_addr;
+    if (C && (in_guard(a, C->st_base) || in_guard(a, C->rst_base)
+           || in_guard(a, C->frm_base))) { error("-stack overflow-"); }
+    signal(SIGSEGV, SIG_DFL); /* not ours: refault with the default action */
+}
+
+long *stack_new(char **basep) {
+    char *b = (char *)mmap(NULL, 2*GUARD_PG+STACK_BYTES, PROT_NONE,
+                           MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED) { error("-out of memory-"); }
+    if (mprotect(b+GUARD_PG, STACK_BYTES, PROT_READ|PROT_WRITE) != 0) { error("-out of memory-"); }
+    *basep = b;
+    return (long *)(b+GUARD_PG);
+}
+
+void stacks_init() {
+    static int armed = 0;
+    C->st_mem  = stack_new(&C->st_base);
+    C->rst_mem = stack_new(&C->rst_base);
+    C->frm_mem = stack_new(&C->frm_base);
+    if (!armed) {
+        struct sigaction sa;
+        armed = 1;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = stack_trap;
+        sa.sa_flags = SA_SIGINFO;
+        sigaction(SIGSEGV, &sa, NULL);
+    }
+}
+
+void stacks_free() {
+    if (C->st_base)  { munmap(C->st_base,  2*GUARD_PG+STACK_BYTES); }
+    if (C->rst_base) { munmap(C->rst_base, 2*GUARD_PG+STACK_BYTES); }
+    if (C->frm_base) { munmap(C->frm_base, 2*GUARD_PG+STACK_BYTES); }
+    C->st_base = C->rst_base = C->frm_base = NULL;
+    C->st_mem = C->rst_mem = C->frm_mem = NULL;
+}
+#else
+#define FRAME_CHECK if (FRAME_SZ <= fp) { error("-frame pool overflow-"); }
+void stacks_init() { }
+void stacks_free() { }
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Superinstruction fusion. */
+
+/* Collapse the hot sequences c() emits (v=v+n / v=v-n statements, the
+   fetch/fetch and fetch/lit compares, and fetch-then-jz loop tests) into
+   single fused opcodes. Replacement is done in place so every jump offset
+   stays valid; leftover cells of a fused span are padded with a short JMP
+   (or a NOP) that execution hops over. is_tgt marks the cells that are
+   the destination of some jump. */
+
+int op_len(int o) { /* opcode plus operand cells */
+    if (o==FETCH || o==STORE || o==LIT || o==JMP || o==JZ || o==JNZ
+        || o==ICALL || o==FETCHR || o==STORER || o==FETCHL || o==STOREL
+        || o==ITCALL || o==AFETCH || o==ASTORE || o==AFILL || o==INATIVE) { return 2; }
+    if (o==ACOPY || BTWI(o, INCV, RJNZ)) { return 3; }
+    return 1;
+}
+
+void mark_targets() {
+    int pc = 0;
+    while (pc < here) {
+        int o = f1(pc);
+        if (o==JMP || o==JZ || o==JNZ) { is_tgt[pc+1+f1(pc+1)] = 1; }
+        pc += op_len(o);
+    }
+    for (int i=1; i<=last; i++) {
+        if (dict[i].kind==IsFunc) { is_tgt[(int)dict[i].val] = 1; }
+    }
+}
+
+int clear_run(int pc, int len) { /* span is in bounds and no jump lands inside it */
+    if (here < pc+len) { return 0; }
+    for (int i=pc+1; i<pc+len; i++) { if (is_tgt[i]) { return 0; } }
+    return 1;
+}
+
+void pad(int pc, int n) { /* fill the unused tail of a fused span */
+    if (n == 1) { vm[pc] = NOP; }
+    else if (n) { vm[pc] = JMP; vm[pc+1] = n-1; } /* offset is fix()-style, relative to the operand cell */
+}
+
+void fuse() {
+    int pc = 0, t;
+    is_tgt = (byte *)calloc(here ? here : 1, 1);
+    if (is_tgt == NULL) { error("-out of memory-"); }
+    mark_targets();
+    while (pc < here) {
+        int o = f1(pc);
+        if (o==FETCH && clear_run(pc,8) && f1(pc+2)==LIT
+                && (f1(pc+4)==IADD || f1(pc+4)==ISUB)
+                && f1(pc+5)==STORE && f1(pc+6)==f1(pc+1) && f1(pc+7)==IDROP) {
+            /* FETCH v; LIT n; IADD|ISUB; STORE v; IDROP  =>  INCV|DECV v n */
+            vm[pc] = (f1(pc+4)==IADD) ? INCV : DECV;
+            vm[pc+2] = vm[pc+3];
+            pad(pc+3, 5);
+        } else if (o==FETCH && clear_run(pc,5) && f1(pc+2)==FETCH && f1(pc+4)==ILT) {
+            /* FETCH a; FETCH b; ILT  =>  FFLT a b */
+            vm[pc] = FFLT;
+            vm[pc+2] = vm[pc+3];
+            pad(pc+3, 2);
+        } else if (o==FETCH && clear_run(pc,5) && f1(pc+2)==LIT && f1(pc+4)==ILT) {
+            /* FETCH a; LIT n; ILT  =>  FLLT a n */
+            vm[pc] = FLLT;
+            vm[pc+2] = vm[pc+3];
+            pad(pc+3, 2);
+        } else if (o==FETCH && clear_run(pc,4) && (f1(pc+2)==JZ || f1(pc+2)==JNZ)) {
+            /* FETCH v; JZ|JNZ off  =>  FJZ|FJNZ v off (offset re-based one cell left) */
+            t = pc+3+f1(pc+3);
+            vm[pc] = (f1(pc+2)==JZ) ? FJZ : FJNZ;
+            vm[pc+2] = t-(pc+2);
+            pad(pc+3, 1);
+        } else if (o==FETCHR && clear_run(pc,8) && f1(pc+2)==LIT
+                && (f1(pc+4)==IADD || f1(pc+4)==ISUB)
+                && f1(pc+5)==STORER && f1(pc+6)==f1(pc+1) && f1(pc+7)==IDROP) {
+            /* FETCHR r; LIT n; IADD|ISUB; STORER r; IDROP  =>  INCR|DECR r n */
+            vm[pc] = (f1(pc+4)==IADD) ? INCR : DECR;
+            vm[pc+2] = vm[pc+3];
+            pad(pc+3, 5);
+        } else if (o==FETCHR && clear_run(pc,5) && f1(pc+2)==FETCHR && f1(pc+4)==ILT) {
+            /* FETCHR a; FETCHR b; ILT  =>  RRLT a b */
+            vm[pc] = RRLT;
+            vm[pc+2] = vm[pc+3];
+            pad(pc+3, 2);
+        } else if (o==FETCHR && clear_run(pc,5) && f1(pc+2)==LIT && f1(pc+4)==ILT) {
+            /* FETCHR a; LIT n; ILT  =>  RLLT a n */
+            vm[pc] = RLLT;
+            vm[pc+2] = vm[pc+3];
+            pad(pc+3, 2);
+        } else if (o==FETCHR && clear_run(pc,4) && (f1(pc+2)==JZ || f1(pc+2)==JNZ)) {
+            /* FETCHR r; JZ|JNZ off  =>  RJZ|RJNZ r off */
+            t = pc+3+f1(pc+3);
+            vm[pc] = (f1(pc+2)==JZ) ? RJZ : RJNZ;
+            vm[pc+2] = t-(pc+2);
+            pad(pc+3, 1);
+        }
+        pc += op_len(f1(pc));
+    }
+    free(is_tgt); is_tgt = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Bytecode verifier. */
+
+/* One pass over the finished stream (post-fuse, or straight off an image)
+   proves the properties run() silently relies on: every opcode is known
+   and its operands index live dict[] entries, registers, or frame slots;
+   every jump, call, and function entry lands on an opcode boundary; and
+   stack depth is consistent along all paths - equal at every join, at
+   least the arity before a call, and zero at every return. With that
+   proved up front the dispatch loop needs no per-opcode defence, which
+   is what makes executing -x images and -i cache splices safe. */
+
+void vfail(char *what, int pc) {
+    printf("(verify: %s at cell %d)\n", what, pc);
+    error("-bad bytecode-");
+}
+
+int jmp_target(int pc) { /* absolute destination of the branch at pc, or -1 */
+    int o = f1(pc);
+    if (o==JMP || o==JZ || o==JNZ) { return pc+1+(int)f1(pc+1); }
+    if (o==FJZ || o==RJZ || o==FJNZ || o==RJNZ) { return pc+2+(int)f1(pc+2); }
+    return -1;
+}
+
+void ck_dict(int pc, int kind) { /* the cell at pc names a dict entry of this kind */
+    int i = (int)f1(pc);
+    if (!BTWI(i,1,last) || (dict[i].kind != kind)) { vfail("bad dict operand", pc); }
+}
+
+void ck_reg(int pc) {
+    if (!BTWI(f1(pc),0,NUM_REGS-1)) { vfail("bad register", pc); }
+}
+
+int op_delta(int o) { /* net data-stack effect; calls are handled separately */
+    if (o==FETCH || o==LIT || o==FETCHR || o==FETCHL || o==ACOPY
+        || o==FFLT || o==FLLT || o==RRLT || o==RLLT) { return 1; }
+    if (o==IDROP || BTWI(o, IADD, IGT) || o==ISHL || o==ISHR
+        || o==JZ || o==JNZ || o==ASTORE) { return -1; }
+    return 0;
+}
+
+void verify() {
+    byte *bd;  /* opcode boundaries */
+    int *dep;  /* stack depth on entry to each boundary, -1 unvisited */
+    int *wl, wn = 0, pc, o, t;
+    if (here == 0) { return; }
+    bd  = (byte *)calloc(here, 1);
+    dep = (int *)malloc(here * sizeof(int));
+    wl  = (int *)malloc(here * sizeof(int));
+    if ((bd==NULL) || (dep==NULL) || (wl==NULL)) { error("-out of memory-"); }
+
+    for (pc = 0; pc < here; pc += op_len(o)) { /* opcodes and operand ranges */
+        o = (int)f1(pc);
+        if (!BTWI(o, HALT, RJNZ)) { vfail("unknown opcode", pc); }
+        if (here < pc + op_len(o)) { vfail("truncated opcode", pc); }
+        bd[pc] = 1;
+        if (o==FETCH || o==STORE || o==INCV || o==DECV || o==FLLT
+            || o==FJZ || o==FJNZ) { ck_dict(pc+1, IsVar); }
+        else if (o==FFLT) { ck_dict(pc+1, IsVar); ck_dict(pc+2, IsVar); }
+        else if (o==ICALL || o==ITCALL) {
+            ck_dict(pc+1, IsFunc);
+            if (!BTWI(dict[f1(pc+1)].args, 0, MAX_PARS)) { vfail("bad arity", pc); }
+        } else if (o==INATIVE) {
+            ck_dict(pc+1, IsNative);
+            t = (int)dict[f1(pc+1)].val;
+            if (!BTWI(t, 0, NUM_NATIVES-1)
+                || (dict[f1(pc+1)].args != natives[t].args)) { vfail("bad native", pc); }
+        } else if (o==AFETCH || o==ASTORE || o==AFILL) { ck_dict(pc+1, IsArr); }
+        else if (o==ACOPY) { ck_dict(pc+1, IsArr); ck_dict(pc+2, IsArr); }
+        else if (o==FETCHR || o==STORER || o==INCR || o==DECR || o==RLLT
+            || o==RJZ || o==RJNZ) { ck_reg(pc+1); }
+        else if (o==RRLT) { ck_reg(pc+1); ck_reg(pc+2); }
+        else if (o==FETCHL || o==STOREL) {
+            if (!BTWI(f1(pc+1), 0, MAX_PARS-1)) { vfail("bad frame slot", pc); }
+        }
+    }
+    for (pc = 0; pc < here; pc += op_len(f1(pc))) { /* control lands on boundaries */
+        o = (int)f1(pc);
+        t = jmp_target(pc);
+        if ((t != -1) && (!BTWI(t, 0, here-1) || !bd[t])) { vfail("bad jump target", pc); }
+        if (o==ICALL || o==ITCALL) {
+            t = (int)dict[f1(pc+1)].val;
+            if (!BTWI(t, 0, here-1) || !bd[t]) { vfail("bad call target", pc); }
+        }
+    }
+    for (int i=1; i<=last; i++) {
+        if (dict[i].kind==IsFunc) {
+            t = (int)dict[i].val;
+            if (!BTWI(t, 0, here-1) || !bd[t]) { vfail("bad function entry", t); }
+        }
+    }
+
+    for (pc = 0; pc < here; pc++) { dep[pc] = -1; } /* stack balance, from each entry */
+    dep[0] = 0; wl[wn++] = 0;
+    for (int i=1; i<=last; i++) {
+        if ((dict[i].kind==IsFunc) && (dep[dict[i].val] == -1)) {
+            dep[dict[i].val] = 0; wl[wn++] = (int)dict[i].val;
+        }
+    }
+    while (wn) {
+        pc = wl[--wn];
+        o = (int)f1(pc);
+        int d = dep[pc], nd;
+        if (o==IRET || o==HALT) {
+            if (d != 0) { vfail("unbalanced return", pc); }
+            continue;
+        }
+        if (o==ICALL || o==ITCALL) { nd = d - dict[f1(pc+1)].args; }
+        else if (o==INATIVE) { nd = d + 1 - dict[f1(pc+1)].args; } /* pops arity, pushes result */
+        else { nd = d + op_delta(o); }
+        if (nd < 0) { vfail("stack underflow", pc); }
+        if (o==ITCALL) { /* the callee's IRET returns for us: leave nothing behind */
+            if (nd != 0) { vfail("unbalanced tail call", pc); }
+            continue;
+        }
+        t = jmp_target(pc);
+        if ((o != JMP) || (t == -1)) { /* fall through to the next opcode */
+            int s = pc + op_len(o);
+            if (here <= s) { vfail("falls off the end", pc); }
+            if (dep[s] == -1) { dep[s] = nd; wl[wn++] = s; }
+            else if (dep[s] != nd) { vfail("depth mismatch", s); }
+        }
+        if (t != -1) {
+            if (dep[t] == -1) { dep[t] = nd; wl[wn++] = t; }
+            else if (dep[t] != nd) { vfail("depth mismatch", t); }
+        }
+    }
+    free(bd); free(dep); free(wl);
+}
+
+/* Benchmark support (-b): wall time always; per-opcode execution counts
+   when built with -D OP_STATS (see the 'bench' makefile target). The
+   counter is one array increment per dispatch, compiled out otherwise. */
+#define NUM_OPS  (RJNZ+1)
+#ifdef OP_STATS
+long opcnt[NUM_OPS];
+#define OPSTAT     opcnt[f1(pc)]++;
+#else
+#define OPSTAT
+#endif
+
+char *op_names[NUM_OPS] = { "halt", "fetch", "store", "lit", "drop", "add",
+    "sub", "mul", "div", "lt", "gt", "jz", "jnz", "jmp", "call", "ret",
+    "fetchr", "storer", "shl", "shr", "fetchl", "storel", "tcall",
+    "afetch", "astore", "afill", "acopy", "native",
+    "nop", "incv", "decv", "fflt", "fllt",
+    "fjz", "incr", "decr", "rrlt", "rllt", "rjz", "fjnz", "rjnz" };
+
+void bench_report(double secs) {
+    printf("(%.3f seconds", secs);
+#ifdef OP_STATS
+    long total = 0;
+    for (int i=0; i<NUM_OPS; i++) { total += opcnt[i]; }
+    printf(", %ld opcodes, %.0f opcodes/sec)\n", total, secs ? total/secs : 0);
+    for (int i=0; i<NUM_OPS; i++) {
+        if (opcnt[i]) { printf("%-8s %14ld %5.1f%%\n", op_names[i], opcnt[i], 100.0*opcnt[i]/total); }
+    }
+#else
+    printf(") -build with -D OP_STATS for the opcode histogram-\n");
+#endif
+}
+
+/* Sampling profiler (-s): a SIGPROF timer (~1000 Hz of cpu time) snapshots
+   the pc the dispatch loop last published into a ring buffer; after the
+   run the samples are aggregated by enclosing function and dis() re-lists
+   with per-cell hit percentages. The pc store costs one write per
+   dispatch and is compiled in with -D SAMPLES (see the 'profile' makefile
+   target); otherwise it all compiles out, like OP_STATS. */
+#ifdef SAMPLES
+#define SAMPLE_RING 65536    /* power of two */
+volatile int sample_pc;      /* published by the dispatch loop */
+volatile long sample_n;
+int sample_ring[SAMPLE_RING];
+long *samp_hits = NULL;      /* per-cell counts, read by dis() */
+long samp_total;
+#define PCSAVE     sample_pc = pc;
+
+#ifdef IS_LINUX
+void sample_tick(int sig) { sample_ring[sample_n++ & (SAMPLE_RING-1)] = sample_pc; }
+
+void sample_start() {
+    struct itimerval tv;
+    signal(SIGPROF, sample_tick);
+    tv.it_interval.tv_sec = 0; tv.it_interval.tv_usec = 1000;
+    tv.it_value = tv.it_interval;
+    setitimer(ITIMER_PROF, &tv, NULL);
+}
+
+void sample_stop() {
+    struct itimerval tv = { {0,0}, {0,0} };
+    setitimer(ITIMER_PROF, &tv, NULL);
+    signal(SIGPROF, SIG_IGN);
+}
+#else
+void sample_start() { }
+void sample_stop()  { }
+#endif
+
+int func_at(int a) { /* the function whose entry most closely precedes a */
+    int best = 0;
+    for (int i=1; i<=last; i++) {
+        if ((dict[i].kind==IsFunc) && (dict[i].val <= a)
+            && (best==0 || dict[best].val < dict[i].val)) { best = i; }
+    }
+    return best;
+}
+
+void sample_report() {
+    long per[DICT_SZ+1], top = 0;
+    long n = (SAMPLE_RING < sample_n) ? SAMPLE_RING : sample_n;
+    memset(per, 0, sizeof(per));
+    samp_hits = (long *)calloc(here ? here : 1, sizeof(long));
+    if (samp_hits == NULL) { error("-out of memory-"); }
+    samp_total = n;
+    for (long i=0; i<n; i++) {
+        int a = sample_ring[i];
+        if (BTWI(a, 0, here-1)) { samp_hits[a]++; }
+        int f = func_at(a);
+        if (f) { per[f]++; } else { top++; }
+    }
+    printf("(%ld samples)\n", sample_n);
+    if (n == 0) { return; }
+    for (int i=1; i<=last; i++) {
+        if (per[i]) { printf("%-12s %8ld %5.1f%%\n", intern_nm(dict[i].nm), per[i], 100.0*per[i]/n); }
+    }
+    if (top) { printf("%-12s %8ld %5.1f%%\n", "(top)", top, 100.0*top/n); }
+}
+#else
+#define PCSAVE
+void sample_start() { }
+void sample_stop()  { }
+void sample_report() { message("-build with -D SAMPLES for the sampling profiler-"); }
+#endif
+
+/* Two dispatch engines share one set of handler bodies:
+   - GCC/Clang: computed goto, each handler jumps straight to the next
+   - MSVC (mc.vcxproj): the classic switch loop */
+#if defined(__GNUC__) || defined(__clang__)
+#define USE_CGOTO 1
+#define OPCASE(o)  lbl_##o
+#define ANEXT      OPSTAT PCSAVE goto *dsp[f1(pc++)]
+#else
+#define OPCASE(o)  case o
+#define ANEXT      goto again
+#endif
+
+/* -m / -T: execution metering. The budget is decremented only when a
+   branch is actually taken backward - the loop back edges - so straight-
+   line dispatch pays nothing and a hot loop pays one decrement-and-test
+   per iteration. -m N caps taken back edges outright; -T ms caps wall
+   time by spending the budget in slices and consulting the clock only
+   when a slice runs out. On exhaustion run() returns 1 and the caller
+   reports the timeout, so a served or batched script that runs away is
+   cut off without taking the process down. */
+long meter_edges;           /* -m: total back-edge budget, 0 = unmetered */
+int meter_msec;             /* -T: wall-time budget in milliseconds */
+TLOCAL long meter_end;      /* wall deadline (ms) for the current run, 0 = none */
+#define METER_SLICE (1<<20) /* back edges between clock checks under -T */
 
-void run(int pc) {
-    long st[1000], rst[1000];
+long mono_ms() { /* wall clock: CPU time would burn N-fold under --jobs */
+#ifdef IS_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000L + ts.tv_nsec/1000000;
+#else
+    return (long)(clock() / (CLOCKS_PER_SEC/1000)); /* CPU time, best we have */
+#endif
+}
+
+#define BACK_EDGE(off) \
+    if (((off) < 0) && (--budget < 0)) { \
+        if (meter_end && (mono_ms() < meter_end)) { budget = METER_SLICE; } \
+        else { sp = spx; return 1; } }
+
+int run(int pc) { /* 0: ran to completion, 1: the meter expired */
+#ifdef IS_LINUX
+    if (C->st_mem == NULL) { stacks_init(); }
+    long *st = C->st_mem, *rst = C->rst_mem, tos = 0;
+#else
+    long st[1000], rst[1000], tos = 0;
+#endif
+    int spx = sp; /* local stack pointer; written back on return */
+    long budget = meter_edges ? meter_edges : LONG_MAX;
+    meter_end = 0;
+    if (meter_msec) {
+        meter_end = mono_ms() + meter_msec;
+        budget = METER_SLICE;
+    }
+#ifdef USE_CGOTO
+    static void *dsp[] = { &&lbl_HALT, &&lbl_FETCH, &&lbl_STORE, &&lbl_LIT,
+        &&lbl_IDROP, &&lbl_IADD, &&lbl_ISUB, &&lbl_IMUL,
+        &&lbl_IDIV, &&lbl_ILT, &&lbl_IGT, &&lbl_JZ, &&lbl_JNZ, &&lbl_JMP,
+        &&lbl_ICALL, &&lbl_IRET, &&lbl_FETCHR, &&lbl_STORER, &&lbl_ISHL,
+        &&lbl_ISHR, &&lbl_FETCHL, &&lbl_STOREL, &&lbl_ITCALL,
+        &&lbl_AFETCH, &&lbl_ASTORE, &&lbl_AFILL, &&lbl_ACOPY, &&lbl_INATIVE,
+        &&lbl_NOP,
+        &&lbl_INCV, &&lbl_DECV, &&lbl_FFLT, &&lbl_FLLT, &&lbl_FJZ,
+        &&lbl_INCR, &&lbl_DECR, &&lbl_RRLT, &&lbl_RLLT, &&lbl_RJZ,
+        &&lbl_FJNZ, &&lbl_RJNZ };
+    ANEXT;
+#else
     again:
+    OPSTAT
+    PCSAVE
     switch (f1(pc++)) {
-        case  FETCH: st[++sp] = dict[f2(pc)].val; pc +=2;
-        ACASE STORE: dict[f2(pc)].val = st[sp]; pc += 2;
-        ACASE LIT1  : st[++sp] = f1(pc++);
-        ACASE LIT2  : st[++sp] = f2(pc); pc += 2;
-        ACASE LIT   : st[++sp] = f4(pc); pc += 4;
-        ACASE IDROP : --sp;
-        ACASE IADD  : NOS += TOS; --sp;
-        ACASE ISUB  : NOS -= TOS; --sp;
-        ACASE IMUL  : NOS *= TOS; --sp;
-        ACASE IDIV  : NOS /= TOS; --sp;
-        ACASE ILT   : NOS =  (NOS<TOS)?1:0; --sp;
-        ACASE IGT   : NOS =  (NOS>TOS)?1:0; --sp;
-        ACASE JMP   : pc += f1(pc);
-        ACASE JZ    : if (st[sp--] == 0) pc += f1(pc); else pc++;
-        ACASE JNZ   : if (st[sp--] != 0) pc += f1(pc); else pc++;
-        ACASE ICALL : rst[rsp++] = pc+2; pc = dict[f2(pc)].val;
-                        // printf("-run:call [%p]-\n", funcs[f2((byte*)pc)]); pc += 2;
-        ACASE IRET : if (rsp) { pc=rst[--rsp]; } else { return; }
-        ACASE HALT  : return;
+#endif
+    OPCASE(FETCH) : st[++spx] = tos; tos = dict[f1(pc)].val; pc++; ANEXT;
+    OPCASE(STORE) : dict[f1(pc)].val = tos; pc++; ANEXT;
+    OPCASE(LIT)   : st[++spx] = tos; tos = f1(pc++); ANEXT;
+    OPCASE(IDROP) : tos = st[spx--]; ANEXT;
+    OPCASE(IADD)  : tos = st[spx--] + tos; ANEXT;
+    OPCASE(ISUB)  : tos = st[spx--] - tos; ANEXT;
+    OPCASE(IMUL)  : tos = st[spx--] * tos; ANEXT;
+    OPCASE(IDIV)  : tos = st[spx--] / tos; ANEXT;
+    OPCASE(ILT)   : tos = (st[spx--] < tos)?1:0; ANEXT;
+    OPCASE(IGT)   : tos = (st[spx--] > tos)?1:0; ANEXT;
+    OPCASE(JMP)   : BACK_EDGE(f1(pc)) pc += f1(pc); ANEXT;
+    OPCASE(JZ)    : if (tos == 0) { BACK_EDGE(f1(pc)) pc += f1(pc); } else pc++; tos = st[spx--]; ANEXT;
+    OPCASE(JNZ)   : if (tos != 0) { BACK_EDGE(f1(pc)) pc += f1(pc); } else pc++; tos = st[spx--]; ANEXT;
+    OPCASE(ICALL) : callcnt[f1(pc)] += prof;
+                    rst[rsp++] = pc+1; rst[rsp++] = lf;
+                    lf = fp; fp += dict[f1(pc)].args;
+                    FRAME_CHECK
+                    for (int i=dict[f1(pc)].args; i--; ) { frames[lf+i] = tos; tos = st[spx--]; }
+                    pc = dict[f1(pc)].val; ANEXT;
+    OPCASE(IRET)  : if (rsp) { fp = lf; lf = rst[--rsp]; pc = rst[--rsp]; ANEXT; } else { sp = spx; return 0; }
+    OPCASE(FETCHR): st[++spx] = tos; tos = regs[f1(pc++)]; ANEXT;
+    OPCASE(STORER): regs[f1(pc++)] = tos; ANEXT;
+    OPCASE(ISHL)  : tos = st[spx--] << tos; ANEXT;
+    OPCASE(ISHR)  : tos = st[spx--] >> tos; ANEXT;
+    OPCASE(FETCHL): st[++spx] = tos; tos = frames[lf+f1(pc)]; pc++; ANEXT;
+    OPCASE(STOREL): frames[lf+f1(pc)] = tos; pc++; ANEXT;
+    OPCASE(ITCALL): BACK_EDGE((int)dict[f1(pc)].val - pc) /* tail recursion is a loop */
+                    callcnt[f1(pc)] += prof;
+                    fp = lf + dict[f1(pc)].args; /* replace the current frame */
+                    for (int i=dict[f1(pc)].args; i--; ) { frames[lf+i] = tos; tos = st[spx--]; }
+                    pc = dict[f1(pc)].val; ANEXT;
+    OPCASE(AFETCH): { dict_t *a = &dict[f1(pc)];
+                      if (!BTWI(tos, 0, a->args-1)) { error("-index out of range-"); }
+                      tos = heap[a->val + tos]; } pc++; ANEXT; /* pop index, push value */
+    OPCASE(ASTORE): { long i = tos; dict_t *a = &dict[f1(pc)]; tos = st[spx--];
+                      if (!BTWI(i, 0, a->args-1)) { error("-index out of range-"); }
+                      heap[a->val + i] = tos; } pc++; ANEXT;
+    OPCASE(AFILL) : { dict_t *a = &dict[f1(pc)];
+                      for (int i=0; i<a->args; i++) { heap[a->val+i] = tos; } } pc++; ANEXT;
+    OPCASE(ACOPY) : { dict_t *d = &dict[f1(pc)], *s = &dict[f1(pc+1)];
+                      int n = (d->args < s->args) ? d->args : s->args;
+                      memcpy(&heap[d->val], &heap[s->val], n*sizeof(long));
+                      st[++spx] = tos; tos = 0; } pc += 2; ANEXT; /* a copy yields 0 */
+    OPCASE(INATIVE):{ dict_t *d = &dict[f1(pc)]; long a[MAX_PARS];
+                      for (int i=d->args; i--; ) { a[i] = tos; tos = st[spx--]; }
+                      st[++spx] = tos; tos = natives[d->val].fn(a); } pc++; ANEXT;
+    OPCASE(NOP)   : ANEXT;
+    OPCASE(INCV)  : dict[f1(pc)].val += f1(pc+1); pc += 2; ANEXT;
+    OPCASE(DECV)  : dict[f1(pc)].val -= f1(pc+1); pc += 2; ANEXT;
+    OPCASE(FFLT)  : st[++spx] = tos; tos = (dict[f1(pc)].val < dict[f1(pc+1)].val)?1:0; pc += 2; ANEXT;
+    OPCASE(FLLT)  : st[++spx] = tos; tos = (dict[f1(pc)].val < f1(pc+1))?1:0; pc += 2; ANEXT;
+    OPCASE(FJZ)   : if (dict[f1(pc)].val) { pc += 2; } else { pc++; BACK_EDGE(f1(pc)) pc += f1(pc); } ANEXT;
+    OPCASE(INCR)  : regs[f1(pc)] += f1(pc+1); pc += 2; ANEXT;
+    OPCASE(DECR)  : regs[f1(pc)] -= f1(pc+1); pc += 2; ANEXT;
+    OPCASE(RRLT)  : st[++spx] = tos; tos = (regs[f1(pc)] < regs[f1(pc+1)])?1:0; pc += 2; ANEXT;
+    OPCASE(RLLT)  : st[++spx] = tos; tos = (regs[f1(pc)] < f1(pc+1))?1:0; pc += 2; ANEXT;
+    OPCASE(RJZ)   : if (regs[f1(pc)]) { pc += 2; } else { pc++; BACK_EDGE(f1(pc)) pc += f1(pc); } ANEXT;
+    OPCASE(FJNZ)  : if (dict[f1(pc)].val) { pc++; BACK_EDGE(f1(pc)) pc += f1(pc); } else { pc += 2; } ANEXT;
+    OPCASE(RJNZ)  : if (regs[f1(pc)]) { pc++; BACK_EDGE(f1(pc)) pc += f1(pc); } else { pc += 2; } ANEXT;
+    OPCASE(HALT)  : sp = spx; return 0;
+#ifndef USE_CGOTO
+    }
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/* JIT backend. */
+
+/* -j: translate vm[] into x86-64 machine code in an mmap'd buffer - one
+   fixed stencil per opcode, working on the same state as the interpreter
+   (dict[], regs[], frames[], heap[]) through absolute addresses, with the
+   native stack carrying call/ret. rax caches tos, rbx points at the
+   spilled stack top, r14/r15 are the frame base/free pointers and r13
+   holds the rsp HALT restores. main() skips fuse() under -j so only the
+   opcodes c() emits appear; anything else (e.g. a fused -x image) aborts
+   translation and jit_run() returns 0 for the run() fallback. */
+
+#if defined(IS_LINUX) && defined(__x86_64__)
+
+typedef struct { int at, bc; } jrel_t; /* rel32 at jbuf[at] -> bytecode cell bc */
+
+byte *jbuf; int jlen;
+int *jntv;                   /* bytecode cell -> native offset */
+jrel_t *jrels; int jnrel;
+
+void jb(int b)  { jbuf[jlen++] = (byte)b; }
+void jd(int n)  { memcpy(jbuf+jlen, &n, 4); jlen += 4; }
+void jq(long n) { memcpy(jbuf+jlen, &n, 8); jlen += 8; }
+void jr(int bc) { jrels[jnrel].at = jlen; jrels[jnrel++].bc = bc; jd(0); }
+
+void jpush()    { jb(0x48); jb(0x83); jb(0xC3); jb(0x08);   /* add rbx, 8     */
+                  jb(0x48); jb(0x89); jb(0x03); }           /* mov [rbx], rax */
+void jpop()     { jb(0x48); jb(0x8B); jb(0x03);             /* mov rax, [rbx] */
+                  jb(0x48); jb(0x83); jb(0xEB); jb(0x08); } /* sub rbx, 8     */
+void jnos()     { jb(0x48); jb(0x8B); jb(0x0B);             /* mov rcx, [rbx] */
+                  jb(0x48); jb(0x83); jb(0xEB); jb(0x08); } /* sub rbx, 8     */
+void jrcx(long a)    { jb(0x48); jb(0xB9); jq(a); }         /* movabs rcx, a  */
+void jtosrcx()  { jb(0x48); jb(0x89); jb(0xC8); }           /* mov rax, rcx   */
+void jchk(int len) { jb(0x48); jb(0x3D); jd(len);           /* cmp rax, len   */
+                  jb(0x0F); jb(0x83); jr(-1); }             /* jae trap       */
+
+int jit_run() {
+    int cap = here*64 + 256;
+    jbuf = (byte *)mmap(NULL, cap, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (jbuf == MAP_FAILED) { return 0; }
+    jntv  = (int *)malloc((here+1)*sizeof(int));
+    jrels = (jrel_t *)malloc((here+8)*sizeof(jrel_t));
+    if (jntv==NULL || jrels==NULL) { error("-out of memory-"); }
+    if (C->st_mem == NULL) { stacks_init(); } /* rbx spills onto the guarded st */
+    jlen = jnrel = 0;
+    int pc = 0, ok = 1, t, n;
+
+    jb(0x53); jb(0x41); jb(0x56); jb(0x41); jb(0x57); jb(0x41); jb(0x55); /* push rbx/r14/r15/r13 */
+    jb(0x55);                                           /* push rbp (INATIVE scratch) */
+    jb(0x48); jb(0xBB); jq((long)C->st_mem);            /* movabs rbx, st     */
+    jb(0x49); jb(0xBE); jq((long)&frames[0]);           /* movabs r14, frames */
+    jb(0x4D); jb(0x89); jb(0xF7);                       /* mov r15, r14       */
+    jb(0x49); jb(0x89); jb(0xE5);                       /* mov r13, rsp       */
+    jb(0xE8); jr(0);                                    /* call bc 0          */
+    jb(0xE9); jr(here);                                 /* jmp epilogue       */
+
+    while ((pc < here) && ok) {
+        jntv[pc] = jlen;
+        switch (f1(pc++)) {
+        case HALT  : jb(0x4C); jb(0x89); jb(0xEC);      /* mov rsp, r13 */
+                     jb(0xE9); jr(here); break;         /* jmp epilogue */
+        case FETCH : jpush(); jrcx((long)&dict[f1(pc++)].val);
+                     jb(0x48); jb(0x8B); jb(0x01); break;          /* mov rax, [rcx] */
+        case STORE : jrcx((long)&dict[f1(pc++)].val);
+                     jb(0x48); jb(0x89); jb(0x01); break;          /* mov [rcx], rax */
+        case LIT   : jpush(); jb(0x48); jb(0xB8); jq(f1(pc++)); break; /* movabs rax, n */
+        case IDROP : jpop(); break;
+        case IADD  : jnos(); jb(0x48); jb(0x01); jb(0xC8); break;  /* add rax, rcx */
+        case ISUB  : jnos(); jb(0x48); jb(0x29); jb(0xC1);         /* sub rcx, rax */
+                     jtosrcx(); break;
+        case IMUL  : jnos(); jb(0x48); jb(0x0F); jb(0xAF); jb(0xC1); break; /* imul rax, rcx */
+        case IDIV  : jnos(); jb(0x49); jb(0x89); jb(0xC0);         /* mov r8, rax  */
+                     jtosrcx(); jb(0x48); jb(0x99);                /* cqo          */
+                     jb(0x49); jb(0xF7); jb(0xF8); break;          /* idiv r8      */
+        case ILT   :
+        case IGT   : n = (f1(pc-1)==ILT) ? 0x9C : 0x9F;            /* setl / setg  */
+                     jnos(); jb(0x31); jb(0xD2);                   /* xor edx, edx */
+                     jb(0x48); jb(0x39); jb(0xC1);                 /* cmp rcx, rax */
+                     jb(0x0F); jb(n); jb(0xC2);                    /* setcc dl     */
+                     jb(0x48); jb(0x89); jb(0xD0); break;          /* mov rax, rdx */
+        case ISHL  :
+        case ISHR  : n = (f1(pc-1)==ISHL) ? 0xE2 : 0xFA;           /* shl / sar rdx, cl */
+                     jnos(); jb(0x48); jb(0x89); jb(0xCA);         /* mov rdx, rcx */
+                     jb(0x48); jb(0x89); jb(0xC1);                 /* mov rcx, rax */
+                     jb(0x48); jb(0xD3); jb(n);
+                     jb(0x48); jb(0x89); jb(0xD0); break;          /* mov rax, rdx */
+        case JMP   : t = pc + f1(pc); pc++;
+                     jb(0xE9); jr(t); break;
+        case JZ    :
+        case JNZ   : n = (f1(pc-1)==JZ) ? 0x84 : 0x85;
+                     t = pc + f1(pc); pc++;
+                     jb(0x48); jb(0x85); jb(0xC0);                 /* test rax, rax   */
+                     jb(0x48); jb(0x8B); jb(0x03);                 /* mov rax, [rbx]  */
+                     jb(0x48); jb(0x8D); jb(0x5B); jb(0xF8);       /* lea rbx,[rbx-8] */
+                     jb(0x0F); jb(n); jr(t); break;                /* jcc target      */
+        case ICALL : t = f1(pc++); n = dict[t].args;
+                     jb(0x41); jb(0x56);                           /* push r14     */
+                     jb(0x4D); jb(0x89); jb(0xFE);                 /* mov r14, r15 */
+                     jb(0x4D); jb(0x8D); jb(0x7F); jb(8*n);        /* lea r15, [r15+8n] */
+                     for (int i=n; i--; ) {
+                         jb(0x49); jb(0x89); jb(0x46); jb(8*i);    /* mov [r14+8i], rax */
+                         jpop();
+                     }
+                     jb(0xE8); jr((int)dict[t].val);               /* call func    */
+                     jb(0x41); jb(0x5E); break;                    /* pop r14      */
+        case ITCALL: t = f1(pc++); n = dict[t].args;
+                     jb(0x4D); jb(0x8D); jb(0x7E); jb(8*n);        /* lea r15, [r14+8n] */
+                     for (int i=n; i--; ) {
+                         jb(0x49); jb(0x89); jb(0x46); jb(8*i);    /* mov [r14+8i], rax */
+                         jpop();
+                     }
+                     jb(0xE9); jr((int)dict[t].val); break;        /* jmp func     */
+        case IRET  : jb(0x4D); jb(0x89); jb(0xF7);                 /* mov r15, r14 */
+                     jb(0xC3); break;                              /* ret          */
+        case FETCHR: jpush(); jrcx((long)&regs[f1(pc++)]);
+                     jb(0x48); jb(0x8B); jb(0x01); break;          /* mov rax, [rcx] */
+        case STORER: jrcx((long)&regs[f1(pc++)]);
+                     jb(0x48); jb(0x89); jb(0x01); break;          /* mov [rcx], rax */
+        case FETCHL: jpush();
+                     jb(0x49); jb(0x8B); jb(0x46); jb(8*f1(pc++)); break; /* mov rax, [r14+8i] */
+        case STOREL: jb(0x49); jb(0x89); jb(0x46); jb(8*f1(pc++)); break; /* mov [r14+8i], rax */
+        case AFETCH: t = f1(pc++); jchk(dict[t].args);
+                     jrcx((long)&heap[dict[t].val]);
+                     jb(0x48); jb(0x8B); jb(0x04); jb(0xC1); break; /* mov rax, [rcx+rax*8] */
+        case ASTORE: t = f1(pc++); jchk(dict[t].args);
+                     jb(0x48); jb(0x89); jb(0xC2);                 /* mov rdx, rax (index) */
+                     jpop();
+                     jrcx((long)&heap[dict[t].val]);
+                     jb(0x48); jb(0x89); jb(0x04); jb(0xD1); break; /* mov [rcx+rdx*8], rax */
+        case AFILL : t = f1(pc++);
+                     jrcx((long)&heap[dict[t].val]);
+                     jb(0xBA); jd(dict[t].args);                   /* mov edx, len    */
+                     jb(0x48); jb(0x89); jb(0x01);                 /* L: mov [rcx], rax */
+                     jb(0x48); jb(0x83); jb(0xC1); jb(0x08);       /* add rcx, 8      */
+                     jb(0xFF); jb(0xCA);                           /* dec edx         */
+                     jb(0x75); jb(0xF5); break;                    /* jnz L           */
+        case ACOPY : t = f1(pc); n = f1(pc+1); pc += 2;
+                     { int len = (dict[t].args < dict[n].args) ? dict[t].args : dict[n].args;
+                       jb(0x48); jb(0xBE); jq((long)&heap[dict[n].val]); /* movabs rsi, src */
+                       jb(0x48); jb(0xBF); jq((long)&heap[dict[t].val]); /* movabs rdi, dst */
+                       jb(0xB9); jd(len); }                        /* mov ecx, len    */
+                     jb(0x48); jb(0x8B); jb(0x16);                 /* L: mov rdx, [rsi] */
+                     jb(0x48); jb(0x89); jb(0x17);                 /* mov [rdi], rdx  */
+                     jb(0x48); jb(0x83); jb(0xC6); jb(0x08);       /* add rsi, 8      */
+                     jb(0x48); jb(0x83); jb(0xC7); jb(0x08);       /* add rdi, 8      */
+                     jb(0xFF); jb(0xC9);                           /* dec ecx         */
+                     jb(0x75); jb(0xEE);                           /* jnz L           */
+                     jpush(); jb(0x31); jb(0xC0); break;           /* xor eax, eax (a copy yields 0) */
+        case INATIVE: t = f1(pc++); n = dict[t].args;
+                     jpush();                                      /* all args now end at [rbx] */
+                     jb(0x48); jb(0x8D); jb(0x7B); jb((byte)(-8*(n-1))); /* lea rdi, [rbx-8(n-1)] */
+                     jb(0x48); jb(0x83); jb(0xEB); jb(8*n);        /* sub rbx, 8n (pop them) */
+                     jb(0x48); jb(0x89); jb(0xE5);                 /* mov rbp, rsp   */
+                     jb(0x48); jb(0x83); jb(0xE4); jb(0xF0);       /* and rsp, -16   */
+                     jb(0x48); jb(0xB8); jq((long)natives[dict[t].val].fn); /* movabs rax, fn */
+                     jb(0xFF); jb(0xD0);                           /* call rax (tos = result) */
+                     jb(0x48); jb(0x89); jb(0xEC); break;          /* mov rsp, rbp   */
+        default    : ok = 0; break;                                /* fused/unknown: fall back */
+        }
     }
+    jntv[here] = jlen;                                  /* epilogue */
+    jb(0x5D);                                           /* pop rbp     */
+    jb(0x41); jb(0x5D); jb(0x41); jb(0x5F);             /* pop r13/r15 */
+    jb(0x41); jb(0x5E); jb(0x5B);                       /* pop r14/rbx */
+    jb(0xC3);                                           /* ret         */
+    int jtrap = jlen;                                   /* bounds-check target */
+    jb(0x4C); jb(0x89); jb(0xEC);                       /* mov rsp, r13 (aligned) */
+    jb(0x48); jb(0xBF); jq((long)"-index out of range-"); /* movabs rdi, msg */
+    jb(0x48); jb(0xB8); jq((long)&error);               /* movabs rax, error */
+    jb(0xFF); jb(0xD0);                                 /* call rax (never returns) */
+    for (int i=0; ok && i<jnrel; i++) {                 /* patch the rel32s */
+        int dst = (jrels[i].bc < 0) ? jtrap : jntv[jrels[i].bc];
+        int rel = dst - (jrels[i].at + 4);
+        memcpy(jbuf+jrels[i].at, &rel, 4);
+    }
+    if (ok) {
+        if (mprotect(jbuf, cap, PROT_READ|PROT_EXEC) != 0) { ok = 0; }
+        else { ((void (*)(void))jbuf)(); }
+    }
+    munmap(jbuf, cap);
+    free(jntv); free(jrels);
+    return ok;
 }
 
+#else
+int jit_run() { message("-no jit for this platform-"); return 0; }
+#endif
+
 /*---------------------------------------------------------------------------*/
 /* Disassembly. */
 
-void dis() {
+#define ACASE    goto again; case
+
+void dis(char *fn) {
     int pc=0, t;
-    FILE *fp = fopen("list.txt", "wt");
-    if (vm[0]==JMP) { fprintf(fp,"; main() is at %d", (int)(vm[1]+1)); }
-    else {  fprintf(fp,"; there is no main() function");  }
+    FILE *fo = fopen(fn, "wt");
+    if (fo == NULL) { error("-cannot create listing-"); }
+    if (vm[0]==JMP) { fprintf(fo,"; main() is at %d", (int)(vm[1]+1)); }
+    else {  fprintf(fo,"; there is no main() function");  }
     again:
-    if (here <= pc) { return; }
+    if (here <= pc) { fprintf(fo, "\n"); fclose(fo); return; }
     int p = pc;
-    fprintf(fp,"\n%04d: %02d ; ", p, f1(pc));
+    fprintf(fo,"\n%04d: %02d ; ", p, f1(pc));
+#ifdef SAMPLES
+    if (samp_hits && samp_hits[p]) { fprintf(fo,"[%4.1f%%] ", 100.0*samp_hits[p]/samp_total); }
+#endif
     switch (f1(pc++)) {
-        case  FETCH : t=f2(pc); fprintf(fp,"fetch [%d] (%s)", t, dict[t].nm); pc+=2;
-        ACASE STORE : t=f2(pc); fprintf(fp,"store [%d] (%s)", t, dict[t].nm); pc+=2;
-        ACASE LIT1  : fprintf(fp,"lit1 %d", f1(pc)); pc+=1;
-        ACASE LIT2  : fprintf(fp,"lit2 %d", f2(pc)); pc+=2;
-        ACASE LIT   : fprintf(fp,"lit4 %ld",f4(pc)); pc+=4;
-        ACASE IDROP : fprintf(fp,"drop");
-        ACASE IADD  : fprintf(fp,"add");
-        ACASE ISUB  : fprintf(fp,"sub");
-        ACASE IMUL  : fprintf(fp,"mul");
-        ACASE IDIV  : fprintf(fp,"div");
-        ACASE ILT   : fprintf(fp,"lt");
-        ACASE IGT   : fprintf(fp,"gt");
-        ACASE JMP   : fprintf(fp,"jmp %d", pc+f1(pc)); pc++;
-        ACASE JZ    : fprintf(fp,"jz %d",  pc+f1(pc)); pc++;
-        ACASE JNZ   : fprintf(fp,"jnz %d", pc+f1(pc)); pc++;
-        ACASE ICALL : t=f2(pc); fprintf(fp,"call %ld (%s)", dict[t].val, dict[t].nm); pc+=2;
-        ACASE IRET  : fprintf(fp,"ret");
-        ACASE HALT  : fprintf(fp,"halt"); goto again;
-    }
-    fprintf(fp, "\n");
-    fclose(fp);
+        case  FETCH : t=f1(pc); fprintf(fo,"fetch [%d] (%s)", t, intern_nm(dict[t].nm)); pc+=1;
+        ACASE STORE : t=f1(pc); fprintf(fo,"store [%d] (%s)", t, intern_nm(dict[t].nm)); pc+=1;
+        ACASE LIT   : fprintf(fo,"lit %d", f1(pc)); pc+=1;
+        ACASE IDROP : fprintf(fo,"drop");
+        ACASE IADD  : fprintf(fo,"add");
+        ACASE ISUB  : fprintf(fo,"sub");
+        ACASE IMUL  : fprintf(fo,"mul");
+        ACASE IDIV  : fprintf(fo,"div");
+        ACASE ILT   : fprintf(fo,"lt");
+        ACASE IGT   : fprintf(fo,"gt");
+        ACASE JMP   : fprintf(fo,"jmp %d", pc+f1(pc)); pc++;
+        ACASE JZ    : fprintf(fo,"jz %d",  pc+f1(pc)); pc++;
+        ACASE JNZ   : fprintf(fo,"jnz %d", pc+f1(pc)); pc++;
+        ACASE ICALL : t=f1(pc); fprintf(fo,"call %ld (%s)", dict[t].val, intern_nm(dict[t].nm)); pc+=1;
+        ACASE ISHL  : fprintf(fo,"shl");
+        ACASE ISHR  : fprintf(fo,"shr");
+        ACASE FETCHL: fprintf(fo,"fetchl %d", f1(pc)); pc+=1;
+        ACASE STOREL: fprintf(fo,"storel %d", f1(pc)); pc+=1;
+        ACASE ITCALL: t=f1(pc); fprintf(fo,"tcall %ld (%s)", dict[t].val, intern_nm(dict[t].nm)); pc+=1;
+        ACASE FETCHR: t=f1(pc); fprintf(fo,"fetchr r%d (%s)", t, intern_nm(dict[reg_slot[t]].nm)); pc+=1;
+        ACASE STORER: t=f1(pc); fprintf(fo,"storer r%d (%s)", t, intern_nm(dict[reg_slot[t]].nm)); pc+=1;
+        ACASE AFETCH: t=f1(pc); fprintf(fo,"afetch [%d] (%s)", t, intern_nm(dict[t].nm)); pc+=1;
+        ACASE ASTORE: t=f1(pc); fprintf(fo,"astore [%d] (%s)", t, intern_nm(dict[t].nm)); pc+=1;
+        ACASE AFILL : t=f1(pc); fprintf(fo,"afill [%d] (%s)", t, intern_nm(dict[t].nm)); pc+=1;
+        ACASE ACOPY : fprintf(fo,"acopy [%d] [%d]", f1(pc), f1(pc+1)); pc+=2;
+        ACASE INATIVE: t=f1(pc); fprintf(fo,"native %ld (%s)", dict[t].val, intern_nm(dict[t].nm)); pc+=1;
+        ACASE NOP   : fprintf(fo,"nop");
+        ACASE INCV  : t=f1(pc); fprintf(fo,"incv [%d] (%s) %d", t, intern_nm(dict[t].nm), f1(pc+1)); pc+=2;
+        ACASE DECV  : t=f1(pc); fprintf(fo,"decv [%d] (%s) %d", t, intern_nm(dict[t].nm), f1(pc+1)); pc+=2;
+        ACASE FFLT  : fprintf(fo,"fflt [%d] [%d]", f1(pc), f1(pc+1)); pc+=2;
+        ACASE FLLT  : fprintf(fo,"fllt [%d] %d", f1(pc), f1(pc+1)); pc+=2;
+        ACASE FJZ   : t=f1(pc); fprintf(fo,"fjz [%d] %d", t, pc+1+f1(pc+1)); pc+=2;
+        ACASE INCR  : fprintf(fo,"incr r%d %d", f1(pc), f1(pc+1)); pc+=2;
+        ACASE DECR  : fprintf(fo,"decr r%d %d", f1(pc), f1(pc+1)); pc+=2;
+        ACASE RRLT  : fprintf(fo,"rrlt r%d r%d", f1(pc), f1(pc+1)); pc+=2;
+        ACASE RLLT  : fprintf(fo,"rllt r%d %d", f1(pc), f1(pc+1)); pc+=2;
+        ACASE RJZ   : fprintf(fo,"rjz r%d %d", f1(pc), pc+1+f1(pc+1)); pc+=2;
+        ACASE FJNZ  : t=f1(pc); fprintf(fo,"fjnz [%d] %d", t, pc+1+f1(pc+1)); pc+=2;
+        ACASE RJNZ  : fprintf(fo,"rjnz r%d %d", f1(pc), pc+1+f1(pc+1)); pc+=2;
+        ACASE IRET  : fprintf(fo,"ret");
+        ACASE HALT  : fprintf(fo,"halt"); goto again;
+    }
+    fprintf(fo, "\n");
+    fclose(fo);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Bytecode images. */
+
+/* A compiled script can be saved with -c and executed later with -x,
+   skipping the whole frontend: magic, code length, dict length, the raw
+   code, the raw dict[] entries, then the intern pool (dict names are
+   intern ids, so the pool text has to travel with the image). */
+
+#define IMG_MAGIC 0x35434d42 /* "BMC5" */
+
+void save_image(const char *fn) {
+    FILE *fo = fopen(fn, "wb");
+    if (fo == NULL) { error("-cannot create image-"); }
+    int magic = IMG_MAGIC;
+    fwrite(&magic, sizeof(int), 1, fo);
+    fwrite(&here,  sizeof(int), 1, fo);
+    fwrite(&last,  sizeof(int), 1, fo);
+    fwrite(vm, sizeof(code), here, fo);
+    fwrite(&dict[1], sizeof(dict_t), last, fo);
+    fwrite(&pool_used, sizeof(int), 1, fo);
+    fwrite(pool, 1, pool_used, fo);
+    fclose(fo);
+}
+
+void load_image(const char *fn) {
+    FILE *fo = fopen(fn, "rb");
+    if (fo == NULL) { error("-cannot open image-"); }
+    int magic = 0, ok = 1, pl = 0;
+    char buf[POOL_SZ];
+    ok &= (fread(&magic, sizeof(int), 1, fo) == 1) && (magic == IMG_MAGIC);
+    ok &= (fread(&here,  sizeof(int), 1, fo) == 1) && (0 < here); /* empty code: vm never allocated */
+    ok &= (fread(&last,  sizeof(int), 1, fo) == 1) && BTWI(last, 0, DICT_SZ);
+    if (ok) { vm_need(here); }
+    ok &= ok && ((int)fread(vm, sizeof(code), here, fo) == here);
+    ok &= ok && ((int)fread(&dict[1], sizeof(dict_t), last, fo) == last);
+    ok &= ok && (fread(&pl, sizeof(int), 1, fo) == 1) && BTWI(pl, 0, POOL_SZ);
+    ok &= ok && ((int)fread(buf, 1, pl, fo) == pl) && ((pl == 0) || (buf[pl-1] == 0));
+    fclose(fo);
+    if (!ok) { error("-bad image-"); }
+    num_ids = pool_used = 0; /* re-intern in order: ids come out unchanged */
+    memset(itab, 0, sizeof(itab));
+    for (int off=0; off<pl; off += (int)strlen(buf+off)+1) { intern(buf+off); }
+    for (int i=1; i<=last; i++) { /* dict fields drive unchecked indexing in run() */
+        dict_t *d = &dict[i];
+        ok &= BTWI(d->kind, IsVar, IsNative);
+        ok &= BTWI(d->nm, 0, num_ids-1);
+        ok &= BTWI(d->reg, 0, NUM_REGS);
+        if (d->kind==IsArr) { ok &= (0 <= d->val) && (1 <= d->args) && (d->val + d->args <= (1<<30)); }
+    }
+    if (!ok) { error("-bad image-"); }
+    for (int i=1; i<=last; i++) { /* arrays: rebuild the (zeroed) heap region */
+        if ((dict[i].kind==IsArr) && (heap_used < dict[i].val + dict[i].args)) {
+            heap_used = (int)dict[i].val + dict[i].args;
+        }
+    }
+    heap_need(heap_used);
 }
 
 /*---------------------------------------------------------------------------*/
 /* Main program. */
 
-void compile() {
+int compile1() { /* 0: the cache register map went stale, start over cold */
+    natives_init();
+    if (par_threads && src) { par_frontend(); } /* workers parse the spans */
     g(JMP); g(0);
-    c(program());
-    int st = dict_find("main", IsFunc);
-    if (st) { vm[1] = (char)(dict[st].val-1); }
+    node_t *prog = program();
+    prog = fold(prog);
+    inline_pass(prog);
+    dce(prog);
+    regalloc();
+    if (ck_hits && (memcmp(reg_slot, ck_regmap, sizeof(ck_regmap)) != 0)) { return 0; }
+    if (load_profile()) { layout(prog); }
+    c(prog);
+    arena_free(); /* the tree is dead now; drop it before run() */
+    par_free();
+    int st = dict_find(intern("main"), IsFunc);
+    if (st) { vm[1] = (code)(dict[st].val-1); }
     else { vm[0] = HALT; }
+    return 1;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc>1) { input_fp = fopen(argv[1], "rt"); }
-
-    here=last=sp=rsp=0;
-    compile();
-    dis();
-    if (input_fp) { fclose(input_fp); }
+void compile() {
+    if (inc && src) { cache_load(); probing = 1; }
+    if (!compile1()) { /* a variable moved in or out of regs[]: recompile cold */
+        char *s = src; int n = src_len;
+        arena_free();
+        src = NULL;
+        free(vm); free(heap);
+        mc_ctx *old = C;
+        C = ctx_new();
+        free(old);
+        lex_init();
+        src = s; src_len = n; src_pos = 0;
+        cache_reset();
+        compile1();
+    }
+    if (inc && src) { cache_save(); }
+}
 
-    printf("(nodes: %d, ", num_nodes);
-    printf("code: %d bytes)\n", here);
-    run(0);
+void dump_vars() {
+    for (int r=0; r<NUM_REGS; r++) { /* registers back to dict[] for the dump */
+        if (reg_slot[r]) { dict[reg_slot[r]].val = regs[r]; }
+    }
     for (int i=1; i<=last; i++) {
         dict_t *p=&dict[i];
-        printf("%s %s: %ld\n", (p->kind==IsVar)?"var":"func", p->nm, p->val);
+        if (p->kind==IsNative) { continue; } /* not script state */
+        if (p->kind==IsArr) { printf("arr %s[%d]\n", intern_nm(p->nm), p->args); }
+        else { printf("%s %s: %ld\n", (p->kind==IsVar)?"var":"func", intern_nm(p->nm), p->val); }
+    }
+}
+
+void reset_vm() { /* back to the post-compile state for the next request */
+    sp = rsp = fp = lf = 0;
+    memset(heap, 0, heap_used*sizeof(long));
+    for (int i=1; i<=last; i++) { if (dict[i].kind==IsVar) { dict[i].val = 0; } }
+    for (int r=0; r<NUM_REGS; r++) { regs[r] = 0; }
+}
+
+/* --serve: compile once, then run once per line read from stdin ('q' or
+   EOF quits), amortizing the whole frontend across requests. */
+void serve() {
+    char line[256];
+    while (fgets(line, sizeof(line), stdin)) {
+        if (line[0]=='q') { return; }
+        reset_vm();
+        if (run(0)) { message("-timeout-"); } /* next request gets a fresh vm */
+        else { dump_vars(); }
+        fflush(stdout);
+    }
+}
+
+int verbose; /* -v: opt into the result dump; production runs stay quiet */
+
+/* --jobs N: each script gets its own mc_ctx on a pool of N worker threads
+   (C is thread-local), so scripts compile and run fully independently in
+   one process; only the result dump is serialized. */
+
+#define MAX_JOBS 64
+char *job_file[MAX_JOBS];
+int num_job = 0, next_job = 0;
+
+#ifdef IS_LINUX
+pthread_mutex_t job_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+void run_job(char *fn) {
+    C = ctx_new();
+    lex_init();
+    read_source(fn);
+    compile();
+    fuse();
+    verify();
+    free(src);
+    int late = run(0); /* a runaway script costs its job, not the batch */
+    if (verbose || late) {
+        pthread_mutex_lock(&job_mtx);
+        printf("== %s ==\n", fn);
+        if (late) { message("-timeout-"); }
+        else { dump_vars(); }
+        fflush(stdout);
+        pthread_mutex_unlock(&job_mtx);
+    }
+    free(vm);
+    free(heap);
+    stacks_free();
+    free(C);
+}
+
+void *job_worker(void *unused) {
+    for (;;) {
+        pthread_mutex_lock(&job_mtx);
+        int i = next_job++;
+        pthread_mutex_unlock(&job_mtx);
+        if (num_job <= i) { return NULL; }
+        run_job(job_file[i]);
+    }
+}
+
+void run_jobs(int n) {
+    pthread_t tid[MAX_JOBS];
+    if (num_job < n) { n = num_job; }
+    for (int i=0; i<n; i++) { pthread_create(&tid[i], NULL, job_worker, NULL); }
+    for (int i=0; i<n; i++) { pthread_join(tid[i], NULL); }
+}
+#else
+void run_jobs(int n) { error("-no thread support-"); }
+#endif
+
+int main(int argc, char *argv[]) {
+    char *img = NULL, *dis_file = NULL;
+    int mode = 0, bench = 0, serve_mode = 0, jobs = 0, samp = 0, jit = 0; /* mode - 0: compile+run, 'c': compile+save, 'x': load+run */
+    C = ctx_new();
+    lex_init();
+    for (int i=1; i<argc; i++) {
+        if ((strcmp(argv[i],"-c")==0) && (i+1<argc)) { mode='c'; img=argv[++i]; }
+        else if ((strcmp(argv[i],"-x")==0) && (i+1<argc)) { mode='x'; img=argv[++i]; }
+        else if ((strcmp(argv[i],"-d")==0) && (i+1<argc)) { dis_file = argv[++i]; }
+        else if (strcmp(argv[i],"-v")==0) { verbose = 1; }
+        else if (strcmp(argv[i],"-b")==0) { bench = 1; }
+        else if (strcmp(argv[i],"-p")==0) { prof = 1; }
+        else if (strcmp(argv[i],"-s")==0) { samp = 1; }
+        else if (strcmp(argv[i],"-i")==0) { inc = 1; }
+        else if (strcmp(argv[i],"-j")==0) { jit = 1; }
+        else if ((strcmp(argv[i],"-t")==0) && (i+1<argc)) { par_threads = atoi(argv[++i]); }
+        else if ((strcmp(argv[i],"-m")==0) && (i+1<argc)) { meter_edges = atol(argv[++i]); }
+        else if ((strcmp(argv[i],"-T")==0) && (i+1<argc)) { meter_msec = atoi(argv[++i]); }
+        else if (strcmp(argv[i],"--serve")==0) { serve_mode = 1; }
+        else if ((strcmp(argv[i],"--jobs")==0) && (i+1<argc)) { jobs = atoi(argv[++i]); }
+        else if (MAX_JOBS <= num_job) { error("-too many scripts-"); }
+        else { job_file[num_job++] = argv[i]; }
+    }
+    if (0 < jobs) { par_threads = 0; inc = 0; /* cache state is file-scope: not safe across jobs */
+        run_jobs(BTWI(jobs,1,MAX_JOBS) ? jobs : MAX_JOBS); return 0; }
+    if (num_job) { read_source(job_file[0]); }
+    if (par_threads) { inc = 0; } /* -t and -i both exist to skip the parse */
+    if (meter_edges || meter_msec) { jit = 0; } /* the meter lives in run() */
+
+    here=last=sp=rsp=fp=lf=0;
+    if (mode=='x') { load_image(img); }
+    else { compile(); if (!jit) { fuse(); } } /* -j translates the unfused stream */
+    verify();
+    if (mode=='c') { save_image(img); return 0; }
+    for (int i=1; i<=last; i++) { /* rebuild the register map (needed after -x) */
+        if (dict[i].reg) { reg_slot[dict[i].reg-1]=i; regs[dict[i].reg-1]=dict[i].val; }
+    }
+    if (dis_file) { dis(dis_file); }
+    if (src) { free(src); src = NULL; }
+
+    if (serve_mode) { serve(); return 0; }
+    if (verbose) { printf("(nodes: %d, code: %d cells)\n", num_nodes, here); }
+    clock_t t0 = clock();
+    if (samp) { sample_start(); }
+    if (!(jit && jit_run())) {
+        if (run(0)) { message("-timeout-"); return 2; } /* distinct from error()'s 1 */
     }
+    if (samp) { sample_stop(); }
+    if (bench) { bench_report((double)(clock()-t0) / CLOCKS_PER_SEC); }
+    if (samp) { sample_report(); if (dis_file) { dis(dis_file); } } /* re-list, annotated */
+    if (prof) { save_profile(); }
+    if (verbose) { dump_vars(); }
     if (sp) { error("-stack not empty-"); }
 
     return 0;